@@ -0,0 +1,191 @@
+#include "BindingTable.h"
+
+#include <cstring>
+
+namespace Detail
+{
+// FNV-1a over UTF-16 code units, so that Latin-1 and UTF-16 spellings of the same ID agree
+static const uint FnvOffset = 2166136261u;
+static const uint FnvPrime = 16777619u;
+
+static uint hashLatin1(const char *data, const int size)
+{
+	uint h = FnvOffset;
+	for (int i = 0; i < size; ++i)
+	{
+		h ^= uchar(data[i]);
+		h *= FnvPrime;
+	}
+	return h;
+}
+static uint hashUnicode(const QChar *data, const int size)
+{
+	uint h = FnvOffset;
+	for (int i = 0; i < size; ++i)
+	{
+		h ^= data[i].unicode();
+		h *= FnvPrime;
+	}
+	return h;
+}
+
+CallbackId::CallbackId(const char *id)
+{
+	const int size = int(qstrlen(id));
+	for (int i = 0; i < size; ++i)
+	{
+		if (uchar(id[i]) >= 0x80)
+		{
+			m_decoded = QString::fromUtf8(id, size);
+			m_unicode = m_decoded.constData();
+			m_size = m_decoded.size();
+			m_hash = hashUnicode(m_unicode, m_size);
+			return;
+		}
+	}
+	m_latin1 = id;
+	m_size = size;
+	m_hash = hashLatin1(m_latin1, m_size);
+}
+CallbackId::CallbackId(const QLatin1String &id)
+	: m_latin1(id.latin1()), m_size(id.size()), m_hash(hashLatin1(m_latin1, m_size))
+{
+}
+CallbackId::CallbackId(const QString &id)
+	: m_unicode(id.constData()), m_size(id.size()), m_hash(hashUnicode(m_unicode, m_size))
+{
+}
+CallbackId::CallbackId(const QStringRef &id)
+	: m_unicode(id.unicode()), m_size(id.size()), m_hash(hashUnicode(m_unicode, m_size))
+{
+}
+
+bool CallbackId::operator==(const QString &key) const
+{
+	if (key.size() != m_size)
+	{
+		return false;
+	}
+	if (m_latin1)
+	{
+		return key == QLatin1String(m_latin1, m_size);
+	}
+	return memcmp(key.constData(), m_unicode, m_size * sizeof(QChar)) == 0;
+}
+
+QString CallbackId::toString() const
+{
+	return m_latin1 ? QString::fromLatin1(m_latin1, m_size) : QString(m_unicode, m_size);
+}
+
+uint CallbackId::hash(const QString &key)
+{
+	return hashUnicode(key.constData(), key.size());
+}
+
+BindingTable::BindingTable()
+{
+}
+
+int BindingTable::indexOf(const CallbackId &id) const
+{
+	if (m_entries.isEmpty())
+	{
+		return -1;
+	}
+	const int mask = m_entries.size() - 1;
+	for (int i = id.hash() & mask;; i = (i + 1) & mask)
+	{
+		const Entry &entry = m_entries.at(i);
+		if (!entry.used)
+		{
+			return -1;
+		}
+		if (entry.hash == id.hash() && id == entry.key)
+		{
+			return i;
+		}
+	}
+}
+
+const Binding *BindingTable::find(const CallbackId &id) const
+{
+	const int index = indexOf(id);
+	return index == -1 ? nullptr : &m_entries.at(index).binding;
+}
+
+void BindingTable::insert(const QString &id, const Binding &binding)
+{
+	// keep the load factor at or below one half, so probe sequences stay short
+	if ((m_size + 1) * 2 > m_entries.size())
+	{
+		rehash(qMax(8, m_entries.size() * 2));
+	}
+	const uint hash = CallbackId::hash(id);
+	const int mask = m_entries.size() - 1;
+	for (int i = hash & mask;; i = (i + 1) & mask)
+	{
+		Entry &entry = m_entries[i];
+		if (!entry.used)
+		{
+			entry.key = id;
+			entry.hash = hash;
+			entry.used = true;
+			entry.binding = binding;
+			++m_size;
+			return;
+		}
+		if (entry.hash == hash && entry.key == id)
+		{
+			entry.binding = binding;
+			return;
+		}
+	}
+}
+
+bool BindingTable::remove(const CallbackId &id)
+{
+	int hole = indexOf(id);
+	if (hole == -1)
+	{
+		return false;
+	}
+	// backward-shift deletion: pull later members of the probe run into the hole
+	const int mask = m_entries.size() - 1;
+	for (int i = (hole + 1) & mask; m_entries.at(i).used; i = (i + 1) & mask)
+	{
+		const int home = m_entries.at(i).hash & mask;
+		const bool canMove = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+		if (canMove)
+		{
+			m_entries[hole] = m_entries.at(i);
+			hole = i;
+		}
+	}
+	m_entries[hole] = Entry();
+	--m_size;
+	return true;
+}
+
+void BindingTable::rehash(const int capacity)
+{
+	QVector<Entry> old = m_entries;
+	m_entries = QVector<Entry>(capacity);
+	m_size = 0;
+	const int mask = capacity - 1;
+	for (const Entry &entry : old)
+	{
+		if (!entry.used)
+		{
+			continue;
+		}
+		int i = entry.hash & mask;
+		while (m_entries.at(i).used)
+		{
+			i = (i + 1) & mask;
+		}
+		m_entries[i] = entry;
+		++m_size;
+	}
+}
+}
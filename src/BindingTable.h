@@ -0,0 +1,148 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include "LogicalGuiImpl.h"
+#include "Snapshot.h"
+
+namespace Detail
+{
+/**
+ * @brief Non-owning view of a callback ID
+ *
+ * Built implicitly from whatever the caller has at hand (a string literal, QLatin1String,
+ * QString or QStringRef) without allocating, and hashed once on construction so that a
+ * @ref BindingTable lookup is a single probe.
+ */
+class CallbackId
+{
+public:
+	CallbackId(const char *id);
+	CallbackId(const QLatin1String &id);
+	CallbackId(const QString &id);
+	CallbackId(const QStringRef &id);
+
+	uint hash() const
+	{
+		return m_hash;
+	}
+	int size() const
+	{
+		return m_size;
+	}
+
+	bool operator==(const QString &key) const;
+	QString toString() const;
+
+	static uint hash(const QString &key);
+
+private:
+	const char *m_latin1 = nullptr;
+	const QChar *m_unicode = nullptr;
+	int m_size = 0;
+	uint m_hash = 0;
+	// only used for non-ASCII string literals, which need UTF-8 decoding
+	QString m_decoded;
+};
+
+/**
+ * @brief Open-addressing hash table mapping callback IDs to bindings
+ *
+ * Uses linear probing with the full hash stored next to each key, so mismatching slots are
+ * skipped without comparing strings. Removal uses backward shifting, so there are no
+ * tombstones and lookups never degrade after many bind/unbind cycles.
+ */
+class BindingTable
+{
+public:
+	BindingTable();
+
+	const Binding *find(const CallbackId &id) const;
+	void insert(const QString &id, const Binding &binding);
+	bool remove(const CallbackId &id);
+
+	int size() const
+	{
+		return m_size;
+	}
+	bool isEmpty() const
+	{
+		return m_size == 0;
+	}
+
+private:
+	struct Entry
+	{
+		QString key;
+		uint hash = 0;
+		bool used = false;
+		Binding binding;
+	};
+	QVector<Entry> m_entries;
+	int m_size = 0;
+
+	int indexOf(const CallbackId &id) const;
+	void rehash(const int capacity);
+};
+
+/// Bindings a Bindable has resolved from its ancestors, see Bindable::findBinding
+struct InheritedBindings
+{
+	BindingTable table;
+	int generation = -1;
+};
+
+/**
+ * @brief A binding found by a lookup, together with the guard that keeps it alive
+ *
+ * The binding belongs to an immutable snapshot of some binding table, so it stays valid (and
+ * unchanged) for the lifetime of the BindingRef even if it's unbound concurrently.
+ */
+class BindingRef
+{
+public:
+	BindingRef() : m_binding(nullptr)
+	{
+	}
+	BindingRef(ReaderLock &&lock, const Binding *binding)
+		: m_lock(std::move(lock)), m_binding(binding)
+	{
+	}
+	BindingRef(BindingRef &&other) : m_lock(std::move(other.m_lock)), m_binding(other.m_binding)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return m_binding;
+	}
+	const Binding *operator->() const
+	{
+		return m_binding;
+	}
+	const Binding &operator*() const
+	{
+		return *m_binding;
+	}
+
+private:
+	ReaderLock m_lock;
+	const Binding *m_binding;
+};
+}
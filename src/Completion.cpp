@@ -0,0 +1,99 @@
+#include "Completion.h"
+
+#include <QThreadStorage>
+
+namespace Detail
+{
+static std::atomic<int> s_spinBudget{4000};
+
+static inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+Completion::Completion() : m_state(Done), m_spins(s_spinBudget.load())
+{
+}
+
+Completion *Completion::forCurrentThread()
+{
+	static QThreadStorage<Completion *> completions;
+	if (!completions.hasLocalData())
+	{
+		completions.setLocalData(new Completion);
+	}
+	return completions.localData();
+}
+
+void Completion::reset()
+{
+	m_state.store(Pending, std::memory_order_relaxed);
+}
+
+bool Completion::spin(const int polls)
+{
+	int backoff = 1;
+	for (int done = 0; done < polls; done += backoff, backoff = qMin(backoff * 2, 64))
+	{
+		if (m_state.load(std::memory_order_acquire) == Done)
+		{
+			return true;
+		}
+		for (int i = 0; i < backoff; ++i)
+		{
+			cpuRelax();
+		}
+	}
+	return m_state.load(std::memory_order_acquire) == Done;
+}
+
+void Completion::wait()
+{
+	const int budget = s_spinBudget.load(std::memory_order_relaxed);
+	m_spins = qMin(m_spins, budget);
+	if (spin(m_spins))
+	{
+		m_spins = qMin(budget, m_spins * 2 + 16);
+		return;
+	}
+	m_spins /= 2;
+
+	QMutexLocker locker(&m_mutex);
+	int expected = Pending;
+	if (m_state.compare_exchange_strong(expected, Parked))
+	{
+		// complete() changes the state under the mutex once we're parked, so by the time we
+		// see Done it has finished touching this object
+		while (m_state.load() != Done)
+		{
+			m_condition.wait(&m_mutex);
+		}
+	}
+}
+
+void Completion::complete()
+{
+	int expected = Pending;
+	if (m_state.compare_exchange_strong(expected, Done))
+	{
+		// the waiter is still spinning, and will notice by itself
+		return;
+	}
+	QMutexLocker locker(&m_mutex);
+	m_state.store(Done);
+	m_condition.wakeOne();
+}
+
+void Completion::setSpinBudget(const int spins)
+{
+	s_spinBudget.store(qMax(0, spins));
+}
+int Completion::spinBudget()
+{
+	return s_spinBudget.load();
+}
+}
@@ -0,0 +1,66 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+
+namespace Detail
+{
+/**
+ * @brief One-shot completion signal that a blocked caller waits on
+ *
+ * Each thread has one, reused for every blocking call it makes. @ref wait first spins for a
+ * while, backing off exponentially between polls, and only parks the thread if the call
+ * hasn't completed by then. Short round-trips therefore finish without a context switch.
+ *
+ * The spin budget adapts: a thread whose calls tend to complete while spinning keeps spinning
+ * for the full budget, while one that usually ends up parking spins less and less.
+ */
+class Completion
+{
+	Q_DISABLE_COPY(Completion)
+public:
+	Completion();
+
+	static Completion *forCurrentThread();
+
+	/// Arms the completion for another call; only the waiting thread may call this
+	void reset();
+	void wait();
+	/// May be called from any thread, exactly once per @ref reset
+	void complete();
+
+	/// The maximum number of polls before parking; 0 parks immediately
+	static void setSpinBudget(const int spins);
+	static int spinBudget();
+
+private:
+	enum State
+	{
+		Pending,
+		Parked,
+		Done
+	};
+	std::atomic<int> m_state;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	int m_spins;
+
+	bool spin(const int polls);
+};
+}
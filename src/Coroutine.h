@@ -0,0 +1,90 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// only included by LogicalGui.h for C++20 (or later) code, the library itself is C++11
+#include <coroutine>
+#include <QThread>
+
+#include "LogicalGuiImpl.h"
+#include "Request.h"
+
+namespace Detail
+{
+/// Resumes a coroutine on the thread of its receiver, or destroys it if that's gone
+class ResumeCall : public DispatchCall
+{
+public:
+	ResumeCall(const QObject *context, std::coroutine_handle<> handle)
+		: DispatchCall(context, &dispatch), m_handle(handle)
+	{
+		m_exempt = true;
+	}
+
+private:
+	std::coroutine_handle<> m_handle;
+
+	static void dispatch(DispatchCall *call, bool receiverAlive)
+	{
+		ResumeCall *self = static_cast<ResumeCall *>(call);
+		const std::coroutine_handle<> handle = self->m_handle;
+		delete self;
+		if (receiverAlive)
+		{
+			handle.resume();
+		}
+		else
+		{
+			handle.destroy();
+		}
+	}
+};
+
+/**
+ * @brief What Bindable::askAsync returns, for co_await
+ *
+ * Wraps the @ref Request that Bindable::request made, so both behave the same way. Once the
+ * coroutine has suspended, a @ref ResumeCall is added as the request's continuation, so
+ * nothing blocks and no thread is tied up while it's pending.
+ */
+template <typename Ret> class RequestAwaiter
+{
+public:
+	RequestAwaiter(const Request<Ret> &request, const QObject *context)
+		: m_request(request), m_context(context)
+	{
+	}
+
+	bool await_ready() const
+	{
+		return m_request.isFinished() && m_context->thread() == QThread::currentThread();
+	}
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		// posted right away if the request is done already
+		m_request.m_continuations->add(new ResumeCall(m_context, handle));
+	}
+	/// A default constructed value if the request was canceled
+	Ret await_resume()
+	{
+		return resultOrDefault(static_cast<const QFuture<Ret> &>(m_request));
+	}
+
+private:
+	Request<Ret> m_request;
+	const QObject *m_context;
+};
+}
@@ -0,0 +1,563 @@
+#include "Dispatcher.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QHash>
+#include <QThreadStorage>
+#include <QElapsedTimer>
+
+#include "Snapshot.h"
+#include "Executor.h"
+
+namespace Detail
+{
+typedef QHash<QThread *, Dispatcher *> DispatcherMap;
+Q_GLOBAL_STATIC(SnapshotCell<DispatcherMap>, dispatchers)
+
+static const QEvent::Type DrainEvent = QEvent::Type(QEvent::registerEventType());
+
+static QAtomicInt s_batching;
+
+// relaxed counters, so recording a batch doesn't serialize the receiver threads on a lock
+namespace
+{
+struct BatchCounters
+{
+	enum
+	{
+		// a batch can't hold more than INT_MAX calls
+		Buckets = 32
+	};
+	std::atomic<quint64> batches{0};
+	std::atomic<quint64> calls{0};
+	std::atomic<int> largestBatch{0};
+	std::atomic<quint64> sizeHistogram[Buckets];
+
+	BatchCounters()
+	{
+		reset();
+	}
+	void reset()
+	{
+		batches.store(0, std::memory_order_relaxed);
+		calls.store(0, std::memory_order_relaxed);
+		largestBatch.store(0, std::memory_order_relaxed);
+		for (std::atomic<quint64> &bucket : sizeHistogram)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+}
+static BatchCounters s_statistics;
+
+static QThreadStorage<int> s_scopedPriority;
+
+PriorityScope::PriorityScope(const CallPriority priority) : m_previous(current())
+{
+	s_scopedPriority.setLocalData(priority);
+}
+PriorityScope::~PriorityScope()
+{
+	s_scopedPriority.setLocalData(m_previous);
+}
+int PriorityScope::current()
+{
+	return s_scopedPriority.hasLocalData() ? s_scopedPriority.localData() : -1;
+}
+
+static void recordBatch(const int size)
+{
+	int bucket = 0;
+	while (bucket + 1 < BatchCounters::Buckets && (quint64(2) << bucket) <= quint64(size))
+	{
+		++bucket;
+	}
+	s_statistics.batches.fetch_add(1, std::memory_order_relaxed);
+	s_statistics.calls.fetch_add(quint64(size), std::memory_order_relaxed);
+	int largest = s_statistics.largestBatch.load(std::memory_order_relaxed);
+	while (size > largest &&
+		   !s_statistics.largestBatch.compare_exchange_weak(largest, size,
+															std::memory_order_relaxed))
+	{
+	}
+	s_statistics.sizeHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// stands in for the list of a closed Continuations
+static DispatchCall *closedList()
+{
+	static DispatchCall sentinel(nullptr, nullptr);
+	return &sentinel;
+}
+
+Continuations::Continuations() : m_head(nullptr)
+{
+}
+
+Continuations::~Continuations()
+{
+	DispatchCall *call = m_head.load();
+	while (call && call != closedList())
+	{
+		DispatchCall *next = call->m_next.load();
+		call->m_function(call, false);
+		call = next;
+	}
+}
+
+void Continuations::add(DispatchCall *call)
+{
+	call->m_exempt = true;
+	DispatchCall *head = m_head.load(std::memory_order_acquire);
+	do
+	{
+		if (head == closedList())
+		{
+			Dispatcher::postToReceiver(call);
+			return;
+		}
+		call->m_next.store(head, std::memory_order_relaxed);
+	} while (!m_head.compare_exchange_weak(head, call, std::memory_order_acq_rel,
+										   std::memory_order_acquire));
+}
+
+void Continuations::close()
+{
+	DispatchCall *call = m_head.exchange(closedList(), std::memory_order_acq_rel);
+	if (call == closedList())
+	{
+		return;
+	}
+	// the list is newest first
+	DispatchCall *reversed = nullptr;
+	while (call)
+	{
+		DispatchCall *next = call->m_next.load(std::memory_order_relaxed);
+		call->m_next.store(reversed, std::memory_order_relaxed);
+		reversed = call;
+		call = next;
+	}
+	while (reversed)
+	{
+		DispatchCall *next = reversed->m_next.load(std::memory_order_relaxed);
+		Dispatcher::postToReceiver(reversed);
+		reversed = next;
+	}
+}
+
+Dispatcher::Lane::Lane() : m_head(&m_stub), m_tail(&m_stub), m_stub(nullptr, nullptr)
+{
+}
+
+Dispatcher::Dispatcher()
+{
+}
+
+Dispatcher::~Dispatcher()
+{
+	// the thread has stopped, so whatever is still queued can only be dropped
+	drain(false);
+}
+
+Dispatcher *Dispatcher::forThread(QThread *thread)
+{
+	{
+		auto snapshot = dispatchers()->read();
+		if (Dispatcher *dispatcher = snapshot->value(thread))
+		{
+			return dispatcher;
+		}
+	}
+
+	Dispatcher *created = nullptr;
+	dispatchers()->update([thread, &created](DispatcherMap &map)
+	{
+		// somebody else might have been quicker
+		if (map.contains(thread))
+		{
+			return;
+		}
+		created = new Dispatcher;
+		created->moveToThread(thread);
+		map.insert(thread, created);
+	});
+	if (!created)
+	{
+		return forThread(thread);
+	}
+
+	QObject::connect(thread, &QObject::destroyed, [thread, created]()
+	{
+		dispatchers()->update([thread](DispatcherMap &map)
+		{
+			map.remove(thread);
+		});
+		delete created;
+	});
+	return created;
+}
+
+void Dispatcher::post(DispatchCall *call)
+{
+	if (!admit(call))
+	{
+		m_rejected.fetch_add(1, std::memory_order_relaxed);
+		if (!call->m_droppable && call->m_deadline < 0)
+		{
+			// a wait() can't tell it from a callback that returned a default value
+			qWarning("Bindable: a blocking call was dropped, the receiver thread's queue is "
+					 "full");
+		}
+		call->m_function(call, false);
+		return;
+	}
+	// once it's in its lane, the receiver thread may run and delete the call at any time
+	const CallPriority priority = call->m_priority;
+	// counted before it can be taken, so the count never goes below zero
+	const int pending = m_count.fetch_add(1);
+	call->m_countedBy.store(this);
+	Lane &lane = m_lanes[priority];
+	lane.push(call);
+	const bool urgent = lane.m_count.fetch_add(1) == 0 && priority == HighPriority;
+	if (urgent)
+	{
+		// a pending event might be stuck behind lots of others
+		m_scheduled.store(true);
+		QCoreApplication::postEvent(this, new QEvent(DrainEvent), Qt::HighEventPriority);
+	}
+	else
+	{
+		schedule();
+	}
+	int highWater = m_highWater.load(std::memory_order_relaxed);
+	while (pending >= highWater &&
+		   !m_highWater.compare_exchange_weak(highWater, pending + 1,
+											  std::memory_order_relaxed))
+	{
+	}
+}
+
+bool Dispatcher::admit(const DispatchCall *call)
+{
+	const int limit = m_limit.load(std::memory_order_relaxed);
+	if (limit <= 0 || call->m_exempt || m_count.load() < limit ||
+		QThread::currentThread() == thread())
+	{
+		return true;
+	}
+	switch (m_policy.load(std::memory_order_relaxed))
+	{
+	case FailWhenFull:
+		return false;
+	case DropOldestWhenFull:
+		return call->m_droppable;
+	default:
+		break;
+	}
+
+	m_blocked.fetch_add(1, std::memory_order_relaxed);
+	QMutexLocker locker(&m_roomMutex);
+	// announced before checking again, so popped() either sees us waiting or we see the room
+	m_waiting.fetch_add(1);
+	bool admitted = true;
+	forever
+	{
+		const int current = m_limit.load(std::memory_order_relaxed);
+		if (current <= 0 || m_count.load() < current)
+		{
+			break;
+		}
+		if (call->m_deadline < 0)
+		{
+			m_room.wait(&m_roomMutex);
+			continue;
+		}
+		const qint64 remaining = call->m_deadline - QElapsedTimer::msecsSinceReference();
+		if (remaining <= 0)
+		{
+			admitted = false;
+			break;
+		}
+		m_room.wait(&m_roomMutex, ulong(remaining));
+	}
+	m_waiting.fetch_sub(1);
+	return admitted;
+}
+
+void Dispatcher::schedule()
+{
+	if (!m_scheduled.exchange(true))
+	{
+		QCoreApplication::postEvent(this, new QEvent(DrainEvent));
+	}
+}
+
+void Dispatcher::withdraw(DispatchCall *call)
+{
+	if (Dispatcher *dispatcher = call->m_countedBy.exchange(nullptr))
+	{
+		dispatcher->m_count.fetch_sub(1);
+		dispatcher->madeRoom();
+	}
+}
+
+void Dispatcher::popped(DispatchCall *call)
+{
+	// whoever clears it uncounts the call, so a withdrawn one isn't uncounted twice
+	if (!call->m_countedBy.exchange(nullptr))
+	{
+		return;
+	}
+	m_count.fetch_sub(1);
+	madeRoom();
+}
+
+void Dispatcher::madeRoom()
+{
+	if (m_waiting.load() > 0)
+	{
+		QMutexLocker locker(&m_roomMutex);
+		m_room.wakeAll();
+	}
+}
+
+bool Dispatcher::dropOldest(const DispatchCall *call) const
+{
+	if (!call->m_droppable || m_policy.load(std::memory_order_relaxed) != DropOldestWhenFull)
+	{
+		return false;
+	}
+	// call itself is still counted
+	const int limit = m_limit.load(std::memory_order_relaxed);
+	return limit > 0 && m_count.load(std::memory_order_relaxed) > limit;
+}
+
+void Dispatcher::setLimit(const int maxPending, const OverflowPolicy policy)
+{
+	m_policy.store(policy);
+	m_limit.store(qMax(0, maxPending));
+	// a higher limit (or none) might make room for somebody
+	QMutexLocker locker(&m_roomMutex);
+	m_room.wakeAll();
+}
+
+QueueStatistics Dispatcher::statistics() const
+{
+	QueueStatistics statistics;
+	statistics.pending = m_count.load(std::memory_order_relaxed);
+	statistics.highWater = m_highWater.load(std::memory_order_relaxed);
+	statistics.blocked = m_blocked.load(std::memory_order_relaxed);
+	statistics.rejected = m_rejected.load(std::memory_order_relaxed);
+	statistics.dropped = m_dropped.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+void Dispatcher::postToReceiver(DispatchCall *call)
+{
+	if (call->m_executor)
+	{
+		call->m_executor->post(call);
+		return;
+	}
+	QObject *receiver = call->m_receiver.data();
+	if (!receiver || !receiver->thread())
+	{
+		call->m_function(call, false);
+		return;
+	}
+	forThread(receiver->thread())->post(call);
+}
+
+void Dispatcher::Lane::push(DispatchCall *call)
+{
+	call->m_next.store(nullptr, std::memory_order_relaxed);
+	DispatchCall *previous = m_head.exchange(call, std::memory_order_acq_rel);
+	previous->m_next.store(call, std::memory_order_release);
+}
+
+// Only called while the lane's m_count says there's a call to take, so the only thing it can
+// ever have to wait for is a producer that's between the two steps of push()
+DispatchCall *Dispatcher::Lane::pop()
+{
+	forever
+	{
+		DispatchCall *tail = m_tail;
+		DispatchCall *next = tail->m_next.load(std::memory_order_acquire);
+		if (tail == &m_stub)
+		{
+			if (!next)
+			{
+				QThread::yieldCurrentThread();
+				continue;
+			}
+			m_tail = next;
+			tail = next;
+			next = next->m_next.load(std::memory_order_acquire);
+		}
+		if (next)
+		{
+			m_tail = next;
+			return tail;
+		}
+		if (tail != m_head.load(std::memory_order_acquire))
+		{
+			QThread::yieldCurrentThread();
+			continue;
+		}
+		// tail is the last call; put the stub behind it so it can be unlinked
+		push(&m_stub);
+		next = tail->m_next.load(std::memory_order_acquire);
+		if (next)
+		{
+			m_tail = next;
+			return tail;
+		}
+		QThread::yieldCurrentThread();
+	}
+}
+
+int Dispatcher::queued() const
+{
+	int count = 0;
+	for (const Lane &lane : m_lanes)
+	{
+		count += lane.m_count.load();
+	}
+	return count;
+}
+
+DispatchCall *Dispatcher::take()
+{
+	int chosen = -1;
+	for (int i = 0; i < PriorityCount; ++i)
+	{
+		if (m_lanes[i].m_count.load() == 0)
+		{
+			continue;
+		}
+		if (chosen < 0 || m_lanes[i].m_passedOver >= AgingLimit)
+		{
+			chosen = i;
+			if (m_lanes[i].m_passedOver >= AgingLimit)
+			{
+				break;
+			}
+		}
+	}
+	if (chosen < 0)
+	{
+		return nullptr;
+	}
+	// lanes below the chosen one that are waiting age, the chosen one starts over
+	for (int i = chosen + 1; i < PriorityCount; ++i)
+	{
+		if (m_lanes[i].m_count.load() > 0)
+		{
+			m_lanes[i].m_passedOver++;
+		}
+	}
+	Lane &lane = m_lanes[chosen];
+	lane.m_passedOver = 0;
+	DispatchCall *call = lane.pop();
+	lane.m_count.fetch_sub(1);
+	return call;
+}
+
+void Dispatcher::setBatching(const bool enabled)
+{
+	s_batching.store(enabled ? 1 : 0);
+}
+bool Dispatcher::isBatching()
+{
+	return s_batching.load() != 0;
+}
+
+BatchStatistics Dispatcher::batchStatistics()
+{
+	BatchStatistics statistics;
+	statistics.batches = s_statistics.batches.load(std::memory_order_relaxed);
+	statistics.calls = s_statistics.calls.load(std::memory_order_relaxed);
+	statistics.largestBatch = s_statistics.largestBatch.load(std::memory_order_relaxed);
+	// up to the largest bucket that was used, like the sizes it was recorded with
+	const std::atomic<quint64> *histogram = s_statistics.sizeHistogram;
+	int used = BatchCounters::Buckets;
+	while (used > 0 && histogram[used - 1].load(std::memory_order_relaxed) == 0)
+	{
+		--used;
+	}
+	statistics.sizeHistogram.resize(used);
+	for (int i = 0; i < used; ++i)
+	{
+		statistics.sizeHistogram[i] = histogram[i].load(std::memory_order_relaxed);
+	}
+	return statistics;
+}
+void Dispatcher::resetBatchStatistics()
+{
+	s_statistics.reset();
+}
+
+bool Dispatcher::event(QEvent *event)
+{
+	if (event->type() == DrainEvent)
+	{
+		drain(true);
+		return true;
+	}
+	return QObject::event(event);
+}
+
+void Dispatcher::drain(const bool run)
+{
+	if (!run)
+	{
+		while (DispatchCall *call = take())
+		{
+			popped(call);
+			call->m_function(call, false);
+		}
+		return;
+	}
+
+	// from here on, posts have to schedule another event
+	m_scheduled.store(false);
+	// calls posted while draining wait for the next event, so a steady stream of them can't
+	// keep the event loop from getting to anything else
+	const int budget = isBatching() ? queued() : 1;
+	int taken = 0;
+	// there may be more events than calls (see post()), so this may not find any
+	while (taken < budget)
+	{
+		DispatchCall *call = take();
+		if (!call)
+		{
+			break;
+		}
+		const bool drop = dropOldest(call);
+		// counted as done before it runs, so a callback that runs a nested event loop (like a
+		// modal dialog) neither holds up the limit nor the calls queued behind it; the
+		// nested loop gets to those through the event scheduled here
+		popped(call);
+		if (queued() > 0)
+		{
+			schedule();
+		}
+		++taken;
+		if (drop)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			call->m_function(call, false);
+		}
+		else
+		{
+			call->m_function(call, call->receiverAlive());
+		}
+	}
+	// only worth its cost when batches can hold more than one call
+	if (taken > 0 && isBatching())
+	{
+		recordBatch(taken);
+	}
+}
+}
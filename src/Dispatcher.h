@@ -0,0 +1,301 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <atomic>
+
+class QThread;
+
+namespace Detail
+{
+class Executor;
+class Dispatcher;
+
+/// Which lane of its receiver thread's @ref Dispatcher a call waits in
+enum CallPriority
+{
+	/// For callbacks a user is waiting on, like prompts
+	HighPriority,
+	NormalPriority,
+	/// For bulk traffic, like progress updates
+	LowPriority,
+	PriorityCount
+};
+
+/**
+ * @brief Gives calls made by the current thread a priority of its own while it exists
+ *
+ * Overrides the priority the bindings were bound with. Scopes can be nested.
+ */
+class PriorityScope
+{
+	Q_DISABLE_COPY(PriorityScope)
+public:
+	explicit PriorityScope(const CallPriority priority);
+	~PriorityScope();
+
+	/// The priority of the innermost scope on the current thread, or -1 if there's none
+	static int current();
+
+private:
+	int m_previous;
+};
+
+/**
+ * @brief A call waiting in a @ref Dispatcher
+ *
+ * The function is invoked exactly once, normally on the receiver's thread (or by its
+ * executor), with receiverAlive telling whether the receiver still exists (it's false if the
+ * call has to be dropped because the receiver's thread went away). It's responsible for the
+ * lifetime of the call.
+ *
+ * Records are linked into the dispatcher's queue intrusively, so posting one doesn't allocate;
+ * a blocking caller can keep its record on the stack.
+ */
+struct DispatchCall
+{
+	typedef void (*Function)(DispatchCall *call, bool receiverAlive);
+
+	DispatchCall(const QObject *receiver, Function function)
+		: m_receiver(const_cast<QObject *>(receiver)), m_function(function),
+		  m_hasReceiver(receiver != nullptr)
+	{
+	}
+
+	/// Calls without a receiver can only be run by an executor, and always count as alive
+	bool receiverAlive() const
+	{
+		return !m_hasReceiver || !m_receiver.isNull();
+	}
+
+	QPointer<QObject> m_receiver;
+	Function m_function;
+	bool m_hasReceiver;
+	/// If set, the call is posted here instead of to the receiver's thread
+	Executor *m_executor = nullptr;
+	std::atomic<DispatchCall *> m_next{nullptr};
+	/// Whether the call may be dropped when its receiver thread's queue is full; nobody must
+	/// be blocked waiting for it
+	bool m_droppable = false;
+	/**
+	 * When to give up waiting for room in a full queue (see BlockWhenFull), in
+	 * QElapsedTimer::msecsSinceReference() terms; -1 to wait as long as it takes
+	 */
+	qint64 m_deadline = -1;
+	CallPriority m_priority = NormalPriority;
+	/// The dispatcher whose limit the call counts toward, from when it's posted until it's
+	/// taken or withdrawn
+	std::atomic<Dispatcher *> m_countedBy{nullptr};
+	/// Continuations and coroutine resumptions are never held back by a queue limit, as
+	/// dropping them would break what's waiting on them without anybody noticing
+	bool m_exempt = false;
+};
+
+/**
+ * @brief Calls waiting for something to be done, to be posted to their receivers' threads then
+ *
+ * Calls can be added from any thread at any time; those added after @ref close are posted
+ * right away. Calls are linked through their queue pointer until they're posted.
+ */
+class Continuations
+{
+	Q_DISABLE_COPY(Continuations)
+public:
+	Continuations();
+	/// Drops calls that were never posted
+	~Continuations();
+
+	void add(DispatchCall *call);
+	/// Posts everything added so far, in the order it was added
+	void close();
+
+private:
+	std::atomic<DispatchCall *> m_head;
+};
+
+/// Counters describing how well batched dispatch amortizes event loop wake-ups
+struct BatchStatistics
+{
+	quint64 batches = 0;
+	quint64 calls = 0;
+	int largestBatch = 0;
+	/// Entry i counts the batches that held between 2^i and 2^(i+1)-1 calls
+	QVector<quint64> sizeHistogram;
+};
+
+/// What happens to calls posted to a receiver thread whose queue is full
+enum OverflowPolicy
+{
+	/**
+	 * The posting thread waits until there's room again, or until the deadline of a call
+	 * with one, like a waitFor(), has passed; then it's dropped as with FailWhenFull
+	 */
+	BlockWhenFull,
+	/**
+	 * The call is dropped right away, as if its receiver had been deleted; dropping a call
+	 * somebody is blocked on, like a wait(), is warned about
+	 */
+	FailWhenFull,
+	/**
+	 * Requests are queued, but while more calls are pending than allowed, the oldest ones
+	 * are dropped instead of being run when their turn comes. Calls that can't be dropped
+	 * later, like a wait(), are dropped right away as with FailWhenFull, so the limit still
+	 * bounds them
+	 */
+	DropOldestWhenFull
+};
+
+/// How busy the queue of one receiver thread is, and what its limit did so far
+struct QueueStatistics
+{
+	/// Calls waiting to be run right now
+	int pending = 0;
+	/// The most calls that were ever waiting at once
+	int highWater = 0;
+	/// Posts that had to wait for room, see BlockWhenFull
+	quint64 blocked = 0;
+	/// Calls dropped when they were posted, see FailWhenFull
+	quint64 rejected = 0;
+	/// Queued calls dropped instead of being run, see DropOldestWhenFull
+	quint64 dropped = 0;
+};
+
+/**
+ * @brief Runs calls from other threads on the thread it lives in
+ *
+ * There's one Dispatcher per receiver thread. Calls are pushed onto a lock-free
+ * multi-producer/single-consumer queue, so posting threads never serialize on a mutex, and
+ * only the producer that finds no event scheduled posts one to wake the receiver thread.
+ *
+ * With batching enabled that event runs everything queued by the time it's delivered,
+ * otherwise it runs a single call. Either way, if calls are left behind, another event is
+ * scheduled before a call runs, so a callback that runs a nested event loop doesn't keep the
+ * calls behind it from running.
+ *
+ * Each @ref CallPriority has a queue of its own, and higher ones are run first. So that a
+ * steady stream of higher priority calls can't starve the others, a lane that has been
+ * passed over @ref AgingLimit times in a row gets its turn. The event for a high priority
+ * call is posted with a high event priority, so it also overtakes other events.
+ *
+ * The number of pending calls can be limited, see @ref setLimit. Calls posted from the
+ * dispatcher's own thread are never held back, so a receiver can't block on its own queue.
+ */
+class Dispatcher : public QObject
+{
+public:
+	~Dispatcher();
+
+	static Dispatcher *forThread(QThread *thread);
+
+	void post(DispatchCall *call);
+	/// Posts to the call's executor if it has one, otherwise to the dispatcher of its
+	/// receiver's thread, or drops it if there's none
+	static void postToReceiver(DispatchCall *call);
+	/**
+	 * @brief Stops counting a queued call that nobody waits for anymore toward the limit
+	 *
+	 * It stays queued until it's taken (and skipped) though. The caller has to keep the
+	 * dispatcher from dropping the call until this returns, see TimedCall.
+	 */
+	static void withdraw(DispatchCall *call);
+
+	/**
+	 * @param maxPending How many calls may be pending at once, 0 for no limit. Posting threads
+	 * check the limit before they queue their call, so concurrent posts may exceed it by one
+	 * each.
+	 */
+	void setLimit(const int maxPending, const OverflowPolicy policy);
+	QueueStatistics statistics() const;
+
+	static void setBatching(const bool enabled);
+	static bool isBatching();
+	static BatchStatistics batchStatistics();
+	static void resetBatchStatistics();
+
+protected:
+	bool event(QEvent *event) override;
+
+private:
+	Dispatcher();
+
+	enum
+	{
+		AgingLimit = 8
+	};
+
+	// Vyukov's intrusive MPSC queue: producers swap themselves into m_head, the consumer
+	// walks from m_tail
+	struct Lane
+	{
+		Lane();
+
+		std::atomic<DispatchCall *> m_head;
+		DispatchCall *m_tail;
+		DispatchCall m_stub;
+		/// Pushed but not yet popped calls
+		std::atomic<int> m_count{0};
+		/// How many calls from higher lanes ran since this one had calls waiting
+		int m_passedOver = 0;
+
+		void push(DispatchCall *call);
+		DispatchCall *pop();
+	};
+	Lane m_lanes[PriorityCount];
+	/// Posted calls that haven't been taken yet, what the limit applies to
+	std::atomic<int> m_count{0};
+	/// Whether a DrainEvent is on its way that will see calls posted now; whoever sets it
+	/// posts one
+	std::atomic<bool> m_scheduled{false};
+
+	std::atomic<int> m_limit{0};
+	std::atomic<int> m_policy{BlockWhenFull};
+	std::atomic<int> m_highWater{0};
+	std::atomic<quint64> m_blocked{0};
+	std::atomic<quint64> m_rejected{0};
+	std::atomic<quint64> m_dropped{0};
+	/// Posting threads waiting for room, woken whenever a call is taken or withdrawn
+	std::atomic<int> m_waiting{0};
+	QMutex m_roomMutex;
+	QWaitCondition m_room;
+
+	/// Applies the limit to a call about to be posted, returns false if it has to be dropped
+	bool admit(const DispatchCall *call);
+	/// Posts a DrainEvent unless one is scheduled already
+	void schedule();
+	/// Counts a call as taken, unless it was withdrawn already
+	void popped(DispatchCall *call);
+	/// Wakes posting threads waiting for room, if there are any
+	void madeRoom();
+	/// Whether the policy says to drop call, which is next in line
+	bool dropOldest(const DispatchCall *call) const;
+	/// Calls in all lanes that haven't been taken yet
+	int queued() const;
+	/// The next call to run, from the highest lane that has one unless another one is due;
+	/// null if there's none
+	DispatchCall *take();
+	void drain(const bool run);
+};
+
+template <typename Func> void callFunctor(void *functor)
+{
+	(*static_cast<Func *>(functor))();
+}
+}
@@ -0,0 +1,247 @@
+#include "Executor.h"
+
+#include <QThread>
+#include <QList>
+
+namespace Detail
+{
+Executor::Executor()
+{
+}
+Executor::~Executor()
+{
+}
+
+void InlineExecutor::post(DispatchCall *call)
+{
+	run(call);
+}
+bool InlineExecutor::isCurrent() const
+{
+	return true;
+}
+
+ThreadExecutor::ThreadExecutor(QThread *thread) : m_thread(thread)
+{
+}
+void ThreadExecutor::post(DispatchCall *call)
+{
+	Dispatcher::forThread(m_thread)->post(call);
+}
+bool ThreadExecutor::isCurrent() const
+{
+	return QThread::currentThread() == m_thread;
+}
+
+class PoolExecutor::Worker : public QThread
+{
+public:
+	Worker(PoolExecutor *pool, const int index) : m_pool(pool), m_index(index)
+	{
+	}
+
+	PoolExecutor *m_pool;
+	int m_index;
+	/// The owner takes from the back, thieves from the front
+	QMutex m_mutex;
+	QList<DispatchCall *> m_calls;
+	/// Calls run so far, to check the shared queue first every once in a while
+	uint m_ticks = 0;
+
+protected:
+	void run() override
+	{
+		m_pool->workerLoop(this);
+	}
+};
+
+PoolExecutor::PoolExecutor(const int threads)
+{
+	const int count = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+	for (int i = 0; i < count; ++i)
+	{
+		m_workers.append(new Worker(this, i));
+	}
+	// only once they're all there, they look at each other's queues
+	for (Worker *worker : m_workers)
+	{
+		worker->start();
+	}
+}
+
+PoolExecutor::~PoolExecutor()
+{
+	{
+		QMutexLocker locker(&m_sleepMutex);
+		m_stopping.store(true);
+		m_wake.wakeAll();
+	}
+	for (Worker *worker : m_workers)
+	{
+		worker->wait();
+	}
+	qDeleteAll(m_workers);
+}
+
+PoolExecutor::Worker *PoolExecutor::currentWorker() const
+{
+	Worker *worker = dynamic_cast<Worker *>(QThread::currentThread());
+	return worker && worker->m_pool == this ? worker : nullptr;
+}
+
+void PoolExecutor::post(DispatchCall *call)
+{
+	// counted first, so a thread that finds nothing to take yet doesn't go to sleep
+	m_queued.fetch_add(1);
+	if (Worker *worker = currentWorker())
+	{
+		QMutexLocker locker(&worker->m_mutex);
+		worker->m_calls.append(call);
+	}
+	else
+	{
+		QMutexLocker locker(&m_sharedMutex);
+		m_shared.enqueue(call);
+	}
+	if (m_sleeping.load() > 0)
+	{
+		QMutexLocker locker(&m_sleepMutex);
+		m_wake.wakeOne();
+	}
+}
+
+bool PoolExecutor::isCurrent() const
+{
+	return currentWorker() != nullptr;
+}
+
+DispatchCall *PoolExecutor::takeShared()
+{
+	QMutexLocker locker(&m_sharedMutex);
+	return m_shared.isEmpty() ? nullptr : m_shared.dequeue();
+}
+
+DispatchCall *PoolExecutor::steal(const Worker *thief)
+{
+	const int count = m_workers.size();
+	for (int i = 1; i < count; ++i)
+	{
+		Worker *victim = m_workers[(thief->m_index + i) % count];
+		QMutexLocker locker(&victim->m_mutex);
+		if (!victim->m_calls.isEmpty())
+		{
+			return victim->m_calls.takeFirst();
+		}
+	}
+	return nullptr;
+}
+
+void PoolExecutor::workerLoop(Worker *worker)
+{
+	forever
+	{
+		DispatchCall *call = nullptr;
+		if (++worker->m_ticks % SharedQueueInterval == 0)
+		{
+			call = takeShared();
+		}
+		if (!call)
+		{
+			QMutexLocker locker(&worker->m_mutex);
+			if (!worker->m_calls.isEmpty())
+			{
+				call = worker->m_calls.takeLast();
+			}
+		}
+		if (!call)
+		{
+			call = takeShared();
+		}
+		if (!call)
+		{
+			call = steal(worker);
+		}
+		if (call)
+		{
+			m_queued.fetch_sub(1);
+			run(call);
+			continue;
+		}
+
+		QMutexLocker locker(&m_sleepMutex);
+		// announced before checking again, so post() either sees us sleeping or we see its call
+		m_sleeping.fetch_add(1);
+		while (m_queued.load() <= 0 && !m_stopping.load())
+		{
+			m_wake.wait(&m_sleepMutex);
+		}
+		m_sleeping.fetch_sub(1);
+		// whatever is still queued is run before stopping
+		if (m_queued.load() <= 0)
+		{
+			return;
+		}
+	}
+}
+
+StrandExecutor::Runner::Runner(StrandExecutor *strand)
+	: DispatchCall(nullptr, &StrandExecutor::runNext), m_strand(strand)
+{
+}
+
+StrandExecutor::StrandExecutor(Executor *target) : m_target(target), m_runner(this)
+{
+}
+
+void StrandExecutor::post(DispatchCall *call)
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		m_calls.enqueue(call);
+		if (m_scheduled)
+		{
+			return;
+		}
+		m_scheduled = true;
+	}
+	m_target->post(&m_runner);
+}
+
+bool StrandExecutor::isCurrent() const
+{
+	return m_runningIn.load() == QThread::currentThread();
+}
+
+void StrandExecutor::runNext(DispatchCall *call, bool alive)
+{
+	StrandExecutor *self = static_cast<Runner *>(call)->m_strand;
+	DispatchCall *next;
+	{
+		QMutexLocker locker(&self->m_mutex);
+		next = self->m_calls.dequeue();
+	}
+	if (alive)
+	{
+		self->m_runningIn.store(QThread::currentThread());
+		run(next);
+		self->m_runningIn.store(nullptr);
+	}
+	else
+	{
+		// the target dropped the runner; that only drops this call, the ones behind it get a
+		// turn of their own below, and are run if the target takes the runner again
+		next->m_function(next, false);
+	}
+
+	{
+		QMutexLocker locker(&self->m_mutex);
+		if (self->m_calls.isEmpty())
+		{
+			self->m_scheduled = false;
+			return;
+		}
+	}
+	// one call per turn, so strands sharing a pool take turns
+	self->m_target->post(&self->m_runner);
+}
+}
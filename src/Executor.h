@@ -0,0 +1,175 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QQueue>
+#include <atomic>
+
+#include "Dispatcher.h"
+
+class QThread;
+
+namespace Detail
+{
+/**
+ * @brief Runs calls to the bindings bound with it, instead of their receivers' threads
+ *
+ * Set with BindingOptions::executor. Calls to such a binding are posted to the executor, unless
+ * @ref isCurrent says the calling thread is one the executor runs calls in, then they're made
+ * directly (so a callback can call its own executor without deadlocking). Lambdas and other
+ * bindings without a receiver can be bound to one, too; if there is a receiver, calls still
+ * check whether it's alive.
+ *
+ * An executor isn't owned by the bindings using it; like a receiver, it has to outlive them and
+ * the calls made to them.
+ */
+class Executor
+{
+	Q_DISABLE_COPY(Executor)
+public:
+	Executor();
+	virtual ~Executor();
+
+	/// Runs the call's function exactly once, sometime later; may be called from any thread
+	virtual void post(DispatchCall *call) = 0;
+	/// Whether calls made from the current thread should be made right away
+	virtual bool isCurrent() const = 0;
+
+protected:
+	static void run(DispatchCall *call)
+	{
+		call->m_function(call, call->receiverAlive());
+	}
+};
+
+/// Runs every call right away, in the calling thread, wherever its receiver lives
+class InlineExecutor : public Executor
+{
+public:
+	void post(DispatchCall *call) override;
+	bool isCurrent() const override;
+};
+
+/**
+ * @brief Runs calls in the given thread's event loop
+ *
+ * Through the same @ref Dispatcher as calls to receivers living there, so priorities and queue
+ * limits apply as well.
+ */
+class ThreadExecutor : public Executor
+{
+public:
+	explicit ThreadExecutor(QThread *thread);
+
+	void post(DispatchCall *call) override;
+	bool isCurrent() const override;
+
+private:
+	QThread *m_thread;
+};
+
+/**
+ * @brief Runs calls on a fixed number of threads of its own, for CPU heavy callbacks
+ *
+ * Calls posted from outside go to a shared queue that's run oldest first, so none of them can
+ * starve under load. Calls posted by a call that's running go to a queue of its own thread's,
+ * which runs the newest first while it's warm in the cache; every @ref SharedQueueInterval
+ * calls a thread looks at the shared queue first, so its own work can't starve that either.
+ * A thread that finds nothing steals the oldest call from another one before it goes to
+ * sleep.
+ *
+ * Call priorities and queue limits don't apply. Calls still queued when the pool is destroyed
+ * are run first.
+ */
+class PoolExecutor : public Executor
+{
+public:
+	/// threads <= 0 means one per core
+	explicit PoolExecutor(const int threads = 0);
+	~PoolExecutor();
+
+	void post(DispatchCall *call) override;
+	bool isCurrent() const override;
+
+	int threadCount() const
+	{
+		return m_workers.size();
+	}
+
+private:
+	enum
+	{
+		SharedQueueInterval = 61
+	};
+
+	class Worker;
+	QVector<Worker *> m_workers;
+	/// Calls posted from outside the pool, taken from the front
+	QMutex m_sharedMutex;
+	QQueue<DispatchCall *> m_shared;
+	/// Calls in all queues
+	std::atomic<int> m_queued{0};
+	std::atomic<bool> m_stopping{false};
+	/// Sleeping threads wait on this, and are woken when something is posted
+	QMutex m_sleepMutex;
+	QWaitCondition m_wake;
+	std::atomic<int> m_sleeping{0};
+
+	Worker *currentWorker() const;
+	/// The oldest call posted from outside, or null if there's none
+	DispatchCall *takeShared();
+	/// Takes from the front of the other queues, starting after thief
+	DispatchCall *steal(const Worker *thief);
+	void workerLoop(Worker *worker);
+};
+
+/**
+ * @brief Runs calls one after the other, in the order they were posted, on another executor
+ *
+ * Gives callbacks that must not run concurrently serialized execution without a thread of
+ * their own: at most one of the strand's calls is queued on or running in the target at any
+ * time. The target has to outlive the strand.
+ */
+class StrandExecutor : public Executor
+{
+public:
+	explicit StrandExecutor(Executor *target);
+
+	void post(DispatchCall *call) override;
+	/// True while the current thread is running one of the strand's calls
+	bool isCurrent() const override;
+
+private:
+	Executor *m_target;
+	QMutex m_mutex;
+	QQueue<DispatchCall *> m_calls;
+	bool m_scheduled = false;
+	std::atomic<QThread *> m_runningIn{nullptr};
+
+	/// Posted to the target to run the next call; there's only ever one of it in flight
+	struct Runner : public DispatchCall
+	{
+		explicit Runner(StrandExecutor *strand);
+		StrandExecutor *m_strand;
+	};
+	Runner m_runner;
+
+	static void runNext(DispatchCall *call, bool alive);
+};
+}
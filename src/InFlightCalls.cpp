@@ -0,0 +1,125 @@
+#include "InFlightCalls.h"
+
+namespace Detail
+{
+/**
+ * Added to the continuations of each registered request. It has no receiver, so it's run as
+ * soon as they're closed, which is when the request is done.
+ */
+class InFlightCalls::Done : public DispatchCall
+{
+public:
+	Done(const QSharedPointer<InFlightCalls> &calls, Entry *entry)
+		: DispatchCall(nullptr, &dispatch), m_calls(calls), m_entry(entry)
+	{
+	}
+
+private:
+	QSharedPointer<InFlightCalls> m_calls;
+	Entry *m_entry;
+
+	static void dispatch(DispatchCall *call, bool)
+	{
+		Done *self = static_cast<Done *>(call);
+		self->m_calls->remove(self->m_entry);
+		delete self;
+	}
+};
+
+Joiners::Joiners() : m_abandoned(false)
+{
+}
+
+bool Joiners::add(const QFutureInterfaceBase &joiner)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_abandoned)
+	{
+		return false;
+	}
+	m_joiners.append(joiner);
+	return true;
+}
+
+bool Joiners::isAbandoned() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_abandoned;
+}
+
+bool Joiners::abandonIfCanceled()
+{
+	QMutexLocker locker(&m_mutex);
+	for (const QFutureInterfaceBase &joiner : m_joiners)
+	{
+		if (!joiner.isCanceled())
+		{
+			return false;
+		}
+	}
+	m_abandoned = true;
+	return true;
+}
+
+InFlightCalls::InFlightCalls()
+{
+}
+
+InFlightCalls::~InFlightCalls()
+{
+	qDeleteAll(m_entries);
+}
+
+bool InFlightCalls::lookup(const CallSignature *signature, const uint hash, const void *key,
+						   void *future, QSharedPointer<Continuations> *continuations)
+{
+	QMutexLocker locker(&m_mutex);
+	Entry *entry = find(signature, hash, key);
+	// it may have been given up on since
+	return entry && entry->addJoiner(future, continuations);
+}
+
+bool InFlightCalls::insert(const QSharedPointer<InFlightCalls> &calls, Entry *entry,
+						   const void *key, void *future,
+						   QSharedPointer<Continuations> *continuations)
+{
+	{
+		QMutexLocker locker(&calls->m_mutex);
+		Entry *existing = calls->find(entry->m_signature, entry->m_hash, key);
+		if (!existing || !existing->addJoiner(future, continuations))
+		{
+			calls->m_entries.insert(entry->m_hash, entry);
+			// not posted yet, so this can't run before the entry is in
+			entry->m_continuations->add(new Done(calls, entry));
+			entry->addJoiner(future, continuations);
+			return false;
+		}
+	}
+	delete entry;
+	return true;
+}
+
+InFlightCalls::Entry *InFlightCalls::find(const CallSignature *signature, const uint hash,
+										  const void *key) const
+{
+	for (auto it = m_entries.find(hash); it != m_entries.end() && it.key() == hash; ++it)
+	{
+		// one that's been given up on stays until it's done, but can't be joined anymore
+		if (it.value()->m_signature == signature && it.value()->matches(key) &&
+			!it.value()->m_joiners->isAbandoned())
+		{
+			return it.value();
+		}
+	}
+	return nullptr;
+}
+
+void InFlightCalls::remove(Entry *entry)
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		m_entries.remove(entry->m_hash, entry);
+	}
+	delete entry;
+}
+}
@@ -0,0 +1,168 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <tuple>
+
+#include "Dispatcher.h"
+#include "Request.h"
+#include "ResultCache.h"
+
+namespace Detail
+{
+/**
+ * @brief The callers sharing one request, see BindingOptions::singleFlight
+ *
+ * Each of them gets a future of its own, so one of them canceling doesn't cancel the others;
+ * the request itself is only given up on once all of them have canceled.
+ */
+class Joiners
+{
+	Q_DISABLE_COPY(Joiners)
+public:
+	Joiners();
+
+	/// Fails if the request has been given up on already
+	bool add(const QFutureInterfaceBase &joiner);
+	bool isAbandoned() const;
+	/// Gives up on the request if every joiner has canceled, returns whether it did
+	bool abandonIfCanceled();
+
+private:
+	mutable QMutex m_mutex;
+	QList<QFutureInterfaceBase> m_joiners;
+	bool m_abandoned;
+};
+
+/**
+ * @brief Requests to a binding that are still running, keyed on their argument values
+ *
+ * Lets calls with the same arguments as one that's already running share its result instead
+ * of making a call of their own. Entries remove themselves once their request is done. May be
+ * used from any thread.
+ */
+class InFlightCalls
+{
+	Q_DISABLE_COPY(InFlightCalls)
+public:
+	InFlightCalls();
+	~InFlightCalls();
+
+	/// If a request for args is running, joins it with a future and continuations of its own
+	template <typename Ret, typename... Args>
+	bool join(QFuture<Ret> &future, QSharedPointer<Continuations> &continuations,
+			  const Args &... args)
+	{
+		return joinKey<Ret, typename CacheKey<Args>::type...>(future, continuations,
+															  keyArgument(args)...);
+	}
+	/**
+	 * @brief Registers a request that's about to be posted, and joins it
+	 *
+	 * key holds the @ref CacheKey of each argument.
+	 * @returns False if it was registered, true if one for the same arguments was registered in
+	 * the meantime; future and continuations then are those of a joiner of that one instead
+	 */
+	template <typename Ret, typename... Args>
+	static bool share(const QSharedPointer<InFlightCalls> &calls, QFuture<Ret> &future,
+					  QSharedPointer<Continuations> &continuations,
+					  const QSharedPointer<Joiners> &joiners, std::tuple<Args...> &&key)
+	{
+		auto entry = new TypedEntry<Ret, Args...>(future, std::move(key));
+		entry->m_signature = CallSignatureFor<Ret, Args...>::get();
+		entry->m_hash = hashArguments(entry->m_key);
+		entry->m_continuations = continuations;
+		entry->m_joiners = joiners;
+		const std::tuple<const Args &...> keyRef(entry->m_key);
+		return insert(calls, entry, &keyRef, &future, &continuations);
+	}
+
+private:
+	struct Entry
+	{
+		virtual ~Entry()
+		{
+		}
+		/// key points to a std::tuple of references to the arguments
+		virtual bool matches(const void *key) const = 0;
+		/**
+		 * Gives the caller a future (of the entry's result type) and continuations that are
+		 * completed along with the entry's; fails if the request has been given up on
+		 */
+		virtual bool addJoiner(void *future, QSharedPointer<Continuations> *continuations) = 0;
+
+		const CallSignature *m_signature;
+		uint m_hash;
+		QSharedPointer<Continuations> m_continuations;
+		QSharedPointer<Joiners> m_joiners;
+	};
+	template <typename Ret, typename... Args> struct TypedEntry : public Entry
+	{
+		TypedEntry(const QFuture<Ret> &future, std::tuple<Args...> &&key)
+			: m_future(future), m_key(std::move(key))
+		{
+		}
+		bool matches(const void *key) const override
+		{
+			return m_key == *static_cast<const std::tuple<const Args &...> *>(key);
+		}
+		bool addJoiner(void *future, QSharedPointer<Continuations> *continuations) override
+		{
+			QFutureInterface<Ret> iface;
+			iface.reportStarted();
+			if (!m_joiners->add(iface))
+			{
+				return false;
+			}
+			const QSharedPointer<Continuations> own(new Continuations);
+			m_continuations->add(new ForwardCall<Ret>(nullptr, m_future, iface, own));
+			*static_cast<QFuture<Ret> *>(future) = iface.future();
+			*continuations = own;
+			return true;
+		}
+
+		QFuture<Ret> m_future;
+		std::tuple<Args...> m_key;
+	};
+	class Done;
+
+	template <typename Ret, typename... Keys>
+	bool joinKey(QFuture<Ret> &future, QSharedPointer<Continuations> &continuations,
+				 const Keys &... keys)
+	{
+		const std::tuple<const Keys &...> key(keys...);
+		return lookup(CallSignatureFor<Ret, Keys...>::get(), hashArguments(key), &key, &future,
+					  &continuations);
+	}
+
+	QMutex m_mutex;
+	QMultiHash<uint, Entry *> m_entries;
+
+	bool lookup(const CallSignature *signature, const uint hash, const void *key, void *future,
+				QSharedPointer<Continuations> *continuations);
+	static bool insert(const QSharedPointer<InFlightCalls> &calls, Entry *entry,
+					   const void *key, void *future,
+					   QSharedPointer<Continuations> *continuations);
+	Entry *find(const CallSignature *signature, const uint hash, const void *key) const;
+	void remove(Entry *entry);
+};
+}
@@ -1,80 +1,494 @@
 #include "LogicalGui.h"
 
-#include <QCoreApplication>
-#include <QSemaphore>
 #include <QThread>
+#include <QElapsedTimer>
 
-#include "QObjectPrivate.h"
+#include "Completion.h"
+
+namespace
+{
+struct BlockingCall : public Detail::DispatchCall
+{
+	BlockingCall(const QObject *receiver, void (*function)(void *), void *context,
+				 Detail::Completion *done)
+		: DispatchCall(receiver, &run), m_function(function), m_context(context), m_done(done)
+	{
+	}
+	void (*m_function)(void *);
+	void *m_context;
+	Detail::Completion *m_done;
+
+	static void run(Detail::DispatchCall *call, bool receiverAlive)
+	{
+		BlockingCall *self = static_cast<BlockingCall *>(call);
+		if (receiverAlive)
+		{
+			self->m_function(self->m_context);
+		}
+		self->m_done->complete();
+	}
+};
+
+void callObject(const Detail::Binding &binding, void **args, const uint movable,
+				const Detail::CallPlan &plan)
+{
+	if (plan.signature)
+	{
+		binding.m_object->marshal(args, *plan.signature);
+	}
+	else
+	{
+		binding.m_object->call(const_cast<QObject *>(binding.m_receiver), args, movable);
+	}
+}
+}
+
+namespace Detail
+{
+TimedCall::TimedCall(const Binding &binding)
+	: DispatchCall(binding.m_receiver, &dispatch), m_state(Pending), m_ref(2), m_timer(binding),
+	  m_trace(binding)
+{
+	prepareCall(this, binding);
+}
+
+bool TimedCall::postAndWait(const int msecs)
+{
+	// posting may already have to wait for room in a full queue
+	QElapsedTimer timer;
+	timer.start();
+	if (msecs >= 0)
+	{
+		m_deadline = QElapsedTimer::msecsSinceReference() + msecs;
+	}
+	Dispatcher::postToReceiver(this);
+
+	bool finished;
+	{
+		QMutexLocker locker(&m_mutex);
+		forever
+		{
+			const int state = m_state.load();
+			if (state == Finished || state == Dropped)
+			{
+				break;
+			}
+			if (msecs < 0)
+			{
+				m_condition.wait(&m_mutex);
+				continue;
+			}
+			const qint64 remaining = msecs - timer.elapsed();
+			if (remaining <= 0 || !m_condition.wait(&m_mutex, ulong(remaining)))
+			{
+				break;
+			}
+		}
+		// if it's still queued, make sure it's never run; if it has started already it keeps
+		// running, but nobody is waiting for it anymore
+		int expected = Pending;
+		if (m_state.compare_exchange_strong(expected, Dropped))
+		{
+			// it was queued all along, which is what the queueing histogram should show
+			m_timer.started();
+			// gives its room back right away; the dispatcher can't drop the call (and go away)
+			// before this returns, as that has to lock m_mutex too
+			Dispatcher::withdraw(this);
+		}
+		finished = m_state.load() == Finished;
+	}
+	return finished;
+}
+
+void TimedCall::dispatch(DispatchCall *call, bool receiverAlive)
+{
+	TimedCall *self = static_cast<TimedCall *>(call);
+	int expected = Pending;
+	if (receiverAlive && self->m_state.compare_exchange_strong(expected, Running))
+	{
+		self->m_timer.started();
+		self->m_trace.started();
+		self->run();
+		self->m_trace.finished();
+		self->finish(Finished);
+	}
+	else
+	{
+		self->finish(Dropped);
+	}
+	self->deref();
+}
+
+void TimedCall::finish(const State state)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_state.load() != Dropped)
+	{
+		m_state.store(state);
+	}
+	m_condition.wakeOne();
+}
+
+void TimedCall::deref()
+{
+	if (!m_ref.deref())
+	{
+		delete this;
+	}
+}
+}
+
+QAtomicInt Bindable::s_generation;
 
 Bindable::Bindable(Bindable *parent) : m_parent(parent)
 {
+	if (parent)
+	{
+		parent->m_childCount.ref();
+	}
 }
 
 Bindable::~Bindable()
 {
+	if (Bindable *parent = m_parent.load())
+	{
+		parent->m_childCount.deref();
+	}
 }
 
 void Bindable::setBindableParent(Bindable *parent)
 {
-	m_parent = parent;
+	if (parent)
+	{
+		parent->m_childCount.ref();
+	}
+	if (Bindable *old = m_parent.fetchAndStoreOrdered(parent))
+	{
+		old->m_childCount.deref();
+	}
+	m_inherited.update([](Detail::InheritedBindings &cache)
+	{
+		cache = Detail::InheritedBindings();
+	});
+	// unlike a bind, this has to bump it even for a leaf: a lookup that's still walking the
+	// old chain would otherwise cache what it finds there under the current generation
+	s_generation.ref();
+}
+
+void Bindable::bind(const QString &id, const QObject *receiver, const char *methodSignature,
+					const Detail::BindingOptions &options)
+{
+	insertBinding(id, slotBinding(receiver, methodSignature), options, false);
+}
+void Bindable::addBinding(const QString &id, const QObject *receiver,
+						  const char *methodSignature, const Detail::BindingOptions &options)
+{
+	insertBinding(id, slotBinding(receiver, methodSignature), options, true);
 }
 
-void Bindable::bind(const QString &id, const QObject *receiver, const char *methodSignature)
+void Bindable::bindRemote(const QString &id, Detail::RemoteEndpoint *endpoint,
+						  const QString &remoteId, const Detail::BindingOptions &options)
+{
+	Detail::SlotObjectBase *object =
+		new Detail::RemoteSlotObject(endpoint, remoteId.isEmpty() ? id : remoteId);
+	insertBinding(id, Detail::Binding(nullptr, object), options, false);
+}
+
+Detail::Binding Bindable::slotBinding(const QObject *receiver, const char *methodSignature)
 {
 	auto mo = receiver->metaObject();
 	Q_ASSERT_X(mo, "Bindable::bind", "Invalid metaobject. Did you forget the QObject macro?");
 	const QMetaMethod method = mo->method(
 		mo->indexOfMethod(QMetaObject::normalizedSignature(methodSignature + 1).constData()));
 	Q_ASSERT_X(method.isValid(), "Bindable::bind", "Invalid method signature");
-	m_bindings.insert(id, Detail::Binding(receiver, method));
+	return Detail::Binding(receiver, method);
+}
+
+void Bindable::setBatchedDispatch(const bool enabled)
+{
+	Detail::Dispatcher::setBatching(enabled);
+}
+Detail::BatchStatistics Bindable::batchStatistics()
+{
+	return Detail::Dispatcher::batchStatistics();
+}
+void Bindable::resetBatchStatistics()
+{
+	Detail::Dispatcher::resetBatchStatistics();
+}
+
+void Bindable::setWaitSpinBudget(const int spins)
+{
+	Detail::Completion::setSpinBudget(spins);
 }
 
-void Bindable::unbind(const QString &id)
+void Bindable::setQueueLimit(QThread *thread, const int maxPending,
+							 const Detail::OverflowPolicy policy)
 {
-	m_bindings.remove(id);
+	Detail::Dispatcher::forThread(thread)->setLimit(maxPending, policy);
+}
+Detail::QueueStatistics Bindable::queueStatistics(QThread *thread)
+{
+	return Detail::Dispatcher::forThread(thread)->statistics();
+}
+
+void Bindable::startTracing(const int capacity)
+{
+	Detail::Tracer::start(capacity);
+}
+void Bindable::stopTracing()
+{
+	Detail::Tracer::stop();
+}
+QByteArray Bindable::traceJson()
+{
+	return Detail::Tracer::toJson();
+}
+
+bool Bindable::startRecording(QIODevice *device)
+{
+	return Detail::Recorder::start(device);
+}
+void Bindable::stopRecording()
+{
+	Detail::Recorder::stop();
+}
+
+#ifdef LOGICALGUI_METRICS
+QHash<QString, Detail::CallbackStatistics> Bindable::callbackStatistics()
+{
+	return Detail::CallbackMetrics::snapshot();
+}
+void Bindable::resetCallbackStatistics()
+{
+	Detail::CallbackMetrics::reset();
+}
+#endif
+
+void Bindable::unbind(const Detail::CallbackId &id)
+{
+	bool removed = false;
+	m_bindings.update([&id, &removed](Detail::BindingTable &table)
+	{
+		removed = table.remove(id);
+	});
+	if (removed)
+	{
+		invalidateInherited();
+	}
+}
+
+void Bindable::invalidateCache(const Detail::CallbackId &id)
+{
+	const Detail::BindingRef binding = findBinding(id);
+	if (binding && binding->m_cache)
+	{
+		binding->m_cache->clear();
+	}
+}
+
+void Bindable::insertBinding(const QString &id, const Detail::Binding &binding,
+							 const Detail::BindingOptions &options, const bool add)
+{
+	Detail::Binding bound = binding;
+	bound.m_traceName = Detail::Tracer::nameId(id);
+	if (options.cacheSize > 0)
+	{
+		bound.m_cache.reset(new Detail::ResultCache(options.cacheSize, options.cacheTtl));
+	}
+	bound.m_priority = options.priority;
+	bound.m_executor = options.executor;
+	if (options.singleFlight)
+	{
+		bound.m_inFlight.reset(new Detail::InFlightCalls);
+	}
+#ifdef LOGICALGUI_METRICS
+	bound.m_metrics = Detail::CallbackMetrics::forId(id);
+#endif
+	m_bindings.update([&id, &bound, add](Detail::BindingTable &table)
+	{
+		const Detail::Binding *existing = add ? table.find(id) : nullptr;
+		bound.m_next = existing ? QSharedPointer<const Detail::Binding>(
+									  new Detail::Binding(*existing))
+								: QSharedPointer<const Detail::Binding>();
+		table.insert(id, bound);
+	});
+	invalidateInherited();
 }
 
-Qt::ConnectionType Bindable::connectionType(const QObject *receiver)
+void Bindable::invalidateInherited()
 {
+	// a Bindable without children can't be in anybody's inherited cache, so the common case
+	// of binding to a leaf object doesn't throw away every other cache
+	if (m_childCount.load() > 0)
+	{
+		s_generation.ref();
+	}
+}
+
+Detail::BindingRef Bindable::findBinding(const Detail::CallbackId &id) const
+{
+	{
+		auto own = m_bindings.read();
+		if (const Detail::Binding *binding = own->find(id))
+		{
+			return Detail::BindingRef(own.takeLock(), binding);
+		}
+	}
+	// read before the parent and walking the chain; writers bump it after publishing (or
+	// re-parenting), so a binding found during a concurrent change is at worst cached under an
+	// already stale generation
+	const int generation = s_generation.loadAcquire();
+	const Bindable *parent = m_parent.loadAcquire();
+	if (!parent)
+	{
+		return Detail::BindingRef();
+	}
+
+	{
+		auto inherited = m_inherited.read();
+		if (inherited->generation == generation)
+		{
+			if (const Detail::Binding *binding = inherited->table.find(id))
+			{
+				return Detail::BindingRef(inherited.takeLock(), binding);
+			}
+		}
+	}
+
+	for (const Bindable *bindable = parent; bindable; bindable = bindable->m_parent.loadAcquire())
+	{
+		auto snapshot = bindable->m_bindings.read();
+		if (const Detail::Binding *binding = snapshot->find(id))
+		{
+			m_inherited.update([&id, binding, generation](Detail::InheritedBindings &cache)
+			{
+				if (cache.generation != generation)
+				{
+					cache = Detail::InheritedBindings();
+					cache.generation = generation;
+				}
+				cache.table.insert(id.toString(), *binding);
+			});
+			return Detail::BindingRef(snapshot.takeLock(), binding);
+		}
+	}
+	return Detail::BindingRef();
+}
+
+Qt::ConnectionType Bindable::connectionType(const Detail::Binding &binding)
+{
+	if (binding.m_executor)
+	{
+		return binding.m_executor->isCurrent() ? Qt::DirectConnection
+											   : Qt::BlockingQueuedConnection;
+	}
+	const QObject *receiver = binding.m_receiver;
 	return receiver == nullptr ? Qt::DirectConnection
 							   : (QThread::currentThread() == receiver->thread()
 									  ? Qt::DirectConnection
 									  : Qt::BlockingQueuedConnection);
 }
 
-void Bindable::callSlotObject(Detail::Binding binding, void **args)
+void Bindable::callSlotObject(const Detail::Binding &binding, const Qt::ConnectionType type,
+							  void **args, const uint movable, const Detail::CallPlan &plan)
 {
-	if (connectionType(binding.m_receiver) == Qt::BlockingQueuedConnection)
+	if (args[0] && plan.convertFrom != QMetaType::UnknownType)
+	{
+		// let the method write its own return type, and convert it afterwards
+		void *result = args[0];
+		args[0] = QMetaType::create(plan.convertFrom);
+		callSlotObject(binding, type, args, movable, *Detail::CallPlan::direct());
+		QMetaType::convert(args[0], plan.convertFrom, result, plan.convertTo);
+		QMetaType::destroy(plan.convertFrom, args[0]);
+		args[0] = result;
+		return;
+	}
+	if (type == Qt::BlockingQueuedConnection)
 	{
-		QSemaphore semaphore;
-		QMetaCallEvent *ev =
-			new QMetaCallEvent(binding.m_object, nullptr, -1, 0, 0, args, &semaphore);
-		QCoreApplication::postEvent(const_cast<QObject *>(binding.m_receiver), ev);
-		semaphore.acquire();
+		const Detail::CallTimer timer(binding);
+		const Detail::TracedDispatch trace(binding);
+		auto call = [&binding, &timer, &trace, &plan, args, movable]()
+		{
+			timer.started();
+			trace.started();
+			callObject(binding, args, movable, plan);
+			trace.finished();
+		};
+		callBlocking(binding, call);
 	}
 	else
 	{
-		binding.m_object->call(const_cast<QObject *>(binding.m_receiver), args);
+		callObject(binding, args, movable, plan);
+	}
+}
+
+bool Bindable::callVariants(const Detail::Binding &binding, const Qt::ConnectionType type,
+							int returnType, QVector<QVariant> &arguments, QVariant &result,
+							QString &error)
+{
+	QVector<int> types(arguments.size());
+	for (int i = 0; i < arguments.size(); ++i)
+	{
+		types[i] = arguments[i].userType();
+	}
+	if (const Detail::CallSignature *own = binding.m_object->signature())
+	{
+		// the compiler checked nothing for these calls, so it has to be done here
+		bool matches = own->count == types.size();
+		for (int i = 0; matches && i < types.size(); ++i)
+		{
+			matches = own->types[i] == types[i];
+		}
+		if (!matches)
+		{
+			error = "the argument types don't match the callback's";
+			return false;
+		}
+		// converted by the caller, if need be
+		returnType = own->returnType;
+	}
+	if (returnType == QMetaType::UnknownType)
+	{
+		error = "the return type is not registered";
+		return false;
+	}
+	const Detail::CallPlan *plan =
+		binding.m_object->plan(Detail::internSignature(returnType, types));
+	if (!plan->valid)
+	{
+		error = "the callback can't be called with these types";
+		return false;
+	}
+
+	void *ret = returnType != QMetaType::Void ? QMetaType::create(returnType) : nullptr;
+	QVarLengthArray<void *, 8> args;
+	args.append(ret);
+	for (QVariant &argument : arguments)
+	{
+		args.append(argument.data());
+	}
+	callSlotObject(binding, type, args.data(), 0, *plan);
+	if (ret)
+	{
+		result = QVariant(returnType, ret);
+		QMetaType::destroy(returnType, ret);
 	}
+	return true;
 }
 
-void Bindable::checkParameterCount(const QMetaMethod &method, const int paramCount)
+void Bindable::postRequest(Detail::DispatchCall *request)
 {
-	Q_ASSERT_X(method.parameterCount() == paramCount, "Bindable::wait",
-			   qPrintable(QString("Incompatible argument count (expected %1, got %2)")
-							  .arg(method.parameterCount(), paramCount)));
+	Detail::Dispatcher::postToReceiver(request);
 }
 
-void Bindable::checkReturnType(const QMetaMethod &method, const int typeId)
+void Bindable::callBlocking(const Detail::Binding &binding, void (*function)(void *),
+							void *context)
 {
-	Q_ASSERT_X(typeId != QMetaType::UnknownType, "Bindable::wait",
-			   "Requested return type is not registered, please use the Q_DECLARE_METATYPE "
-			   "macro to make it known to Qt's meta-object system");
-	Q_ASSERT_X(
-		method.returnType() == typeId ||
-			QMetaType::hasRegisteredConverterFunction(method.returnType(), typeId),
-		"Bindable::wait",
-		qPrintable(
-			QString("Requested return type (%1) is incompatible method return type (%2)")
-				.arg(QMetaType::typeName(typeId), QMetaType::typeName(method.returnType()))));
+	Detail::Completion *done = Detail::Completion::forCurrentThread();
+	done->reset();
+	BlockingCall call(binding.m_receiver, function, context, done);
+	Detail::prepareCall(&call, binding);
+	Detail::Dispatcher::postToReceiver(&call);
+	done->wait();
 }
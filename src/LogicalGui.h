@@ -18,9 +18,19 @@
 #include <QObject>
 #include <QMetaMethod>
 #include <QFutureInterface>
+#include <QVarLengthArray>
+#include <iterator>
 #include <tuple>
 
 #include "LogicalGuiImpl.h"
+#include "BindingTable.h"
+#include "Dispatcher.h"
+#include "Request.h"
+#include "Remote.h"
+#include "Recording.h"
+#ifdef __cpp_impl_coroutine
+#include "Coroutine.h"
+#endif
 
 /**
  * @class Bindable
@@ -31,7 +41,8 @@
  * * Callback - A QObject slot, member function, lambda, static member function, functor, global
  *function etc.
  * * Callback ID - A string identifying a callback. Used by @ref wait and @ref request to
- *look-up callbacks set with @ref bind
+ *look-up callbacks set with @ref bind. Can be given as a string literal, QLatin1String, QString
+ *or QStringRef; looking it up never allocates
  * * Binding - A mapping between a callback ID and a callback. Set using @ref bind and unset
  *using @ref unbind
  * * Bindable - A container of bindings, which can be called by inheriting from Bindable
@@ -70,6 +81,24 @@
  * You could also create a constructor for MyClass that takes a Bindable *, and then pass that
  *to the Bindable::Bindable constructor
  *
+ * @par Threading
+ *
+ * @ref bind, @ref unbind and @ref setBindableParent may be called from any thread, also while
+ *other threads are calling @ref wait or @ref request on the same object. A call that has
+ *already looked up its binding keeps using it until it returns, even if the binding is removed
+ *or replaced in the meantime; calls started afterwards see the new binding.
+ *
+ * Callbacks normally run in their receiver's thread, and lambdas and other callbacks without a
+ *receiver in the calling thread. A binding can be given an executor instead (see
+ *Detail::BindingOptions::executor), for example to run CPU heavy callbacks in parallel on a
+ *Detail::PoolExecutor, or ones that have to run one at a time on a Detail::StrandExecutor:
+ * @code
+ * static Detail::PoolExecutor pool;
+ * Detail::BindingOptions options;
+ * options.executor = &pool;
+ * obj->bind("Checksum", &checksum, options);
+ * @endcode
+ *
  * @par Unit Testing
  *
  * LogicalGui is also useful for unit testing. Just bind callback IDs to placeholder callbacks,
@@ -82,25 +111,89 @@
  */
 class Bindable
 {
+	Q_DISABLE_COPY(Bindable)
 	friend class tst_LogicalGui;
+	friend class Detail::RemoteHost;
+	friend class Detail::Replay;
 
 	template <typename Ret, typename... Params>
-	class RequestRunner : public Detail::BaseRequestRunner<Ret, Params...>
+	class RequestCall : public Detail::BaseRequestCall<Ret, Params...>
 	{
 	public:
-		using Detail::BaseRequestRunner<Ret, Params...>::BaseRequestRunner;
+		using Detail::BaseRequestCall<Ret, Params...>::BaseRequestCall;
 
 	private:
-		template <std::size_t... S>
-		Ret call(const QString &id, Bindable *parent, std::tuple<Params...> params,
-				 Detail::Sequence<S...>)
+		void runFunctor(QFutureInterface<Ret> &iface, const Detail::Binding &binding,
+						std::tuple<Params...> &params) override
 		{
-			return parent->wait<Ret>(id, std::get<S>(params)...);
+			reportTuple(iface, binding, params,
+						typename Detail::SequenceGenerator<sizeof...(Params)>::type());
 		}
-		Ret runFunctor(const QString &id, Bindable *parent, std::tuple<Params...> params)
+	};
+
+	template <typename Ret, typename Item>
+	class BulkCall : public Detail::BaseBulkCall<Ret, Item>
+	{
+	public:
+		using Detail::BaseBulkCall<Ret, Item>::BaseBulkCall;
+
+	private:
+		void runFunctor(QFutureInterface<Ret> &iface, const Detail::Binding &binding,
+						Item &item, const int index) override
 		{
-			return call(id, parent, params,
-						typename Detail::SequenceGenerator<sizeof...(Params)>::type());
+			// every item is only used once
+			reportItem(iface, binding, std::move(item), index);
+		}
+	};
+
+	template <typename Ret, typename... Params> class WaitForCall : public Detail::TimedCall
+	{
+	public:
+		template <typename... Args>
+		explicit WaitForCall(const Detail::Binding &binding, Args &&... args)
+			: Detail::TimedCall(binding), m_binding(binding),
+			  m_params(std::forward<Args>(args)...)
+		{
+		}
+
+		Ret result()
+		{
+			return std::move(m_result);
+		}
+
+	private:
+		Detail::Binding m_binding;
+		std::tuple<Params...> m_params;
+		Ret m_result;
+
+		void run() override
+		{
+			m_result = invokeTuple<Ret>(
+				m_binding, m_params, typename Detail::SequenceGenerator<sizeof...(Params)>::type());
+		}
+	};
+	template <typename... Params> class WaitForCall<void, Params...> : public Detail::TimedCall
+	{
+	public:
+		template <typename... Args>
+		explicit WaitForCall(const Detail::Binding &binding, Args &&... args)
+			: Detail::TimedCall(binding), m_binding(binding),
+			  m_params(std::forward<Args>(args)...)
+		{
+		}
+
+		void result()
+		{
+		}
+
+	private:
+		Detail::Binding m_binding;
+		std::tuple<Params...> m_params;
+
+		void run() override
+		{
+			invokeTupleVoid(m_binding, m_params,
+							typename Detail::SequenceGenerator<sizeof...(Params)>::type());
 		}
 	};
 
@@ -126,8 +219,16 @@ public:
 	 * @param id              The callback ID, as will be given to @ref wait or @ref request
 	 * @param receiver        The QObject instance on which the callback will be called
 	 * @param methodSignature The signature of the callback, as given by SLOT(...)
+	 * @param options         For example whether results may be cached, see
+	 *Detail::BindingOptions
+	 *
+	 * The method is looked up once, here, and then called through its meta-object's static
+	 *dispatcher, so this is nearly as cheap to call as a pointer-to-member binding. Argument
+	 *types have to match the method's parameter types exactly; the first call from each call
+	 *site checks that, and calls that don't match are refused with a warning.
 	 */
-	void bind(const QString &id, const QObject *receiver, const char *methodSignature);
+	void bind(const QString &id, const QObject *receiver, const char *methodSignature,
+			  const Detail::BindingOptions &options = Detail::BindingOptions());
 
 #ifdef DOXYGEN
 	/**
@@ -135,18 +236,18 @@ public:
 	 * @param id       The callback ID, as will be given to @ref wait or @ref request
 	 * @param receiver The QObject instance on which the callback will be called
 	 * @param slot     The member function that will be called
+	 * @param options  For example the priority of calls to it, see Detail::BindingOptions
 	 */
-	void bind(const QString &id, const QObject *receiver, Func slot);
+	void bind(const QString &id, const QObject *receiver, Func slot,
+			  const Detail::BindingOptions &options = Detail::BindingOptions());
 #else
 	template <typename Func>
 	void bind(const QString &id,
-			  const typename QtPrivate::FunctionPointer<Func>::Object *receiver, Func slot)
+			  const typename QtPrivate::FunctionPointer<Func>::Object *receiver, Func slot,
+			  const Detail::BindingOptions &options = Detail::BindingOptions())
 	{
-		typedef QtPrivate::FunctionPointer<Func> SlotType;
-		m_bindings.insert(
-			id, Detail::Binding(
-					receiver, new QtPrivate::QSlotObject<Func, typename SlotType::Arguments,
-														 typename SlotType::ReturnType>(slot)));
+		insertBinding(id, Detail::Binding(receiver, Detail::makeSlotObject(slot)), options,
+					  false);
 	}
 #endif
 
@@ -155,86 +256,500 @@ public:
 	 * @brief Bind a lambda, static member, functor or similar to a callback ID
 	 * @param id   The callback ID, as will be given to @ref wait and @ref request
 	 * @param slot The lambda, static member, functor or similar that will be called
+	 * @param options  See Detail::BindingOptions
 	 */
-	void bind(const QString &id, Func slot);
+	void bind(const QString &id, Func slot,
+			  const Detail::BindingOptions &options = Detail::BindingOptions());
 #else
-	template <typename Func> void bind(const QString &id, Func slot)
+	template <typename Func>
+	void bind(const QString &id, Func slot,
+			  const Detail::BindingOptions &options = Detail::BindingOptions())
 	{
-		typedef QtPrivate::FunctionPointer<Func> SlotType;
-		m_bindings.insert(
-			id, Detail::Binding(
-					nullptr, new QtPrivate::QSlotObject<Func, typename SlotType::Arguments,
-														typename SlotType::ReturnType>(slot)));
+		insertBinding(id, Detail::Binding(nullptr, Detail::makeSlotObject(slot)), options,
+					  false);
 	}
 #endif
 
+#ifdef DOXYGEN
 	/**
-	 * @brief Remove the binding with the given ID
-	 * @param id The callback ID of the binding to remove
+	 * @brief Like @ref bind, but keeps the bindings that are already there
+	 *
+	 * Each callback ID can have any number of bindings, possibly to receivers in different
+	 *threads. @ref wait and @ref request only call the one added last, @ref waitAll and
+	 *@ref requestAll call all of them.
 	 */
-	void unbind(const QString &id);
+	void addBinding(const QString &id, ...);
+#else
+	void addBinding(const QString &id, const QObject *receiver, const char *methodSignature,
+					const Detail::BindingOptions &options = Detail::BindingOptions());
+	template <typename Func>
+	void addBinding(const QString &id,
+					const typename QtPrivate::FunctionPointer<Func>::Object *receiver,
+					Func slot, const Detail::BindingOptions &options = Detail::BindingOptions())
+	{
+		insertBinding(id, Detail::Binding(receiver, Detail::makeSlotObject(slot)), options,
+					  true);
+	}
+	template <typename Func>
+	void addBinding(const QString &id, Func slot,
+					const Detail::BindingOptions &options = Detail::BindingOptions())
+	{
+		insertBinding(id, Detail::Binding(nullptr, Detail::makeSlotObject(slot)), options,
+					  true);
+	}
+#endif
 
-private:
-	QMap<QString, Detail::Binding> m_bindings;
+	/**
+	 * @brief Bind a callback ID to a callback in another process
+	 * @param id       The callback ID, as will be given to @ref wait or @ref request
+	 * @param endpoint The connection to the process, which serves its bindings with a
+	 *Detail::RemoteHost
+	 * @param remoteId The callback ID there, if it's not the same
+	 * @param options  See Detail::BindingOptions
+	 *
+	 * The argument and return types are checked against the callback's on the other end, when
+	 *it's called. Calls are made in the calling thread, which waits for the result, unless the
+	 *options have an executor.
+	 */
+	void bindRemote(const QString &id, Detail::RemoteEndpoint *endpoint,
+					const QString &remoteId = QString(),
+					const Detail::BindingOptions &options = Detail::BindingOptions());
+
+	/**
+	 * @brief Remove the bindings with the given ID
+	 * @param id The callback ID of the bindings to remove
+	 */
+	void unbind(const Detail::CallbackId &id);
+	/**
+	 * @brief Forget the cached results of the binding with the given ID
+	 *
+	 * Only does something if the binding was bound with Detail::BindingOptions::cacheSize.
+	 */
+	void invalidateCache(const Detail::CallbackId &id);
+
+	/**
+	 * @brief Coalesce cross-thread calls into one event per receiver thread
+	 *
+	 * Calls to receivers in another thread are always queued per receiver thread. When
+	 *batching is enabled, a single event runs everything that has been queued by the time the
+	 *receiver's event loop gets to it; otherwise each event runs one call, so other events can
+	 *interleave. Disabled by default.
+	 * @see batchStatistics
+	 */
+	static void setBatchedDispatch(const bool enabled);
+	/// How many calls each batch held since the last @ref resetBatchStatistics, while batched
+	/// dispatch was enabled
+	static Detail::BatchStatistics batchStatistics();
+	static void resetBatchStatistics();
+
+	/**
+	 * @brief How long a blocking cross-thread @ref wait spins before it sleeps
+	 *
+	 * A waiting thread polls for the result with exponential backoff for up to this many
+	 *pause instructions before it parks, so callbacks that answer within a few microseconds
+	 *don't cost a context switch. Each thread adapts its own spin time below this limit. 0
+	 *disables spinning; the default is 4000.
+	 */
+	static void setWaitSpinBudget(const int spins);
+
+	/**
+	 * @brief Limit how many calls may be queued for receivers in the given thread
+	 * @param maxPending How many calls may be pending at once, 0 (the default) for no limit
+	 * @param policy     What happens to calls posted while that many are pending
+	 *
+	 * Keeps a burst of calls from other threads from piling up in the receiver thread's event
+	 *queue. Calls count from when they're posted until the receiver thread takes them, or until
+	 *a @ref waitFor that gave up on them withdraws them. A request whose future was canceled
+	 *keeps counting until it's taken (and skipped), as nothing tells the queue about it.
+	 *Detail::DropOldestWhenFull only drops queued requests, whose futures are canceled then;
+	 *blocking calls posted while the queue is full are dropped right away instead. Calls made
+	 *from the receiver thread itself aren't limited, and neither are continuations (see
+	 *Detail::Request::then) or resumed coroutines, which count but are never dropped.
+	 *
+	 * A @ref waitFor waits for room only until its deadline, and reports a call dropped by the
+	 *limit as not done in time. A @ref wait can't report it at all: with
+	 *Detail::FailWhenFull or Detail::DropOldestWhenFull it returns a default constructed
+	 *value, after a warning.
+	 * @see queueStatistics
+	 */
+	static void setQueueLimit(QThread *thread, const int maxPending,
+							  const Detail::OverflowPolicy policy = Detail::BlockWhenFull);
+	/// How many calls are queued for receivers in the given thread, and the limit's effect
+	static Detail::QueueStatistics queueStatistics(QThread *thread);
+
+#if defined(LOGICALGUI_METRICS) || defined(DOXYGEN)
+	/**
+	 * @brief Call counts and latencies per callback ID, summed over all Bindables
+	 *
+	 * Only available if LogicalGui (and everything including it) is built with
+	 *LOGICALGUI_METRICS defined; otherwise nothing is recorded at all. IDs that haven't been
+	 *called since the last @ref resetCallbackStatistics are left out.
+	 */
+	static QHash<QString, Detail::CallbackStatistics> callbackStatistics();
+	static void resetCallbackStatistics();
+#endif
+
+	/**
+	 * @brief Start recording calls for a timeline view
+	 * @param capacity How many events to keep, older ones are overwritten (rounded up to a
+	 *power of two)
+	 *
+	 * Records when @ref wait calls begin and end, and when calls to receivers in other
+	 *threads are posted, start running and finish, along with their threads and callback IDs.
+	 * @see traceJson
+	 */
+	static void startTracing(const int capacity = 65536);
+	static void stopTracing();
+	/**
+	 * @brief The recorded events in Chrome's trace-event format
+	 *
+	 * Can be loaded by chrome://tracing, Perfetto and other trace viewers. May be called while
+	 *tracing is still going on.
+	 */
+	static QByteArray traceJson();
 
-	Bindable *m_parent;
+	/**
+	 * @brief Start logging the calls made through any Bindable to device, for replaying them
+	 *
+	 * Logs each call's callback ID, arguments, calling thread and time, in a compact binary
+	 *format that Detail::Replay can drive against a set of bindings again later, in the same
+	 *or another process. Arguments are serialized with their QDataStream operators, so their
+	 *types have to be registered (along with stream operators for custom types); calls whose
+	 *arguments can't be serialized are left out, after a warning. Calls answered from a
+	 *binding's result cache aren't logged.
+	 *
+	 * The device has to be open for writing, and stay open until @ref stopRecording; writes to
+	 *it are made from the calling threads, one at a time, so a QFile or QBuffer works, a socket
+	 *doesn't.
+	 * @returns False if the device isn't writable
+	 */
+	static bool startRecording(QIODevice *device);
+	static void stopRecording();
 
 private:
-	Qt::ConnectionType connectionType(const QObject *receiver);
-	void callSlotObject(Detail::Binding binding, void **args);
-	void checkParameterCount(const QMetaMethod &method, const int paramCount);
-	void checkReturnType(const QMetaMethod &method, const int typeId);
+	/// Published as immutable snapshots, so lookups from any thread never block on bind/unbind
+	Detail::SnapshotCell<Detail::BindingTable> m_bindings;
+
+	QAtomicPointer<Bindable> m_parent;
+
+	/// Bindings resolved from ancestors, valid as long as their generation is current
+	mutable Detail::SnapshotCell<Detail::InheritedBindings> m_inherited;
+	/// Number of Bindables that have this one as their parent
+	QAtomicInt m_childCount;
 
+	/// Bumped whenever a Bindable with children changes its bindings or its parent
+	static QAtomicInt s_generation;
+
+private:
+	void insertBinding(const QString &id, const Detail::Binding &binding,
+					   const Detail::BindingOptions &options, const bool add);
+	static Detail::Binding slotBinding(const QObject *receiver, const char *methodSignature);
+	void invalidateInherited();
+	Detail::BindingRef findBinding(const Detail::CallbackId &id) const;
+	static Qt::ConnectionType connectionType(const Detail::Binding &binding);
+	static void callSlotObject(const Detail::Binding &binding, const Qt::ConnectionType type,
+							   void **args, const uint movable, const Detail::CallPlan &plan);
+	/**
+	 * Calls binding with arguments whose types are only known at runtime, checking them as far
+	 * as that's possible. On failure, error says why.
+	 */
+	static bool callVariants(const Detail::Binding &binding, const Qt::ConnectionType type,
+							 int returnType, QVector<QVariant> &arguments, QVariant &result,
+							 QString &error);
+	static void postRequest(Detail::DispatchCall *request);
+	/// Logs a call if recording, costs a relaxed load otherwise
 	template <typename Ret, typename... Params>
-	Ret waitInternal(const QString &id, Params... params)
+	static void recordCall(const Detail::Binding &binding, const int flags,
+						   const Params &... params)
 	{
-		if (!m_bindings.contains(id) && m_parent)
+		if (Detail::Recorder::isEnabled())
 		{
-			return m_parent->waitInternal<Ret, Params...>(id, params...);
+			const void *args[] = {nullptr, &params...};
+			Detail::Recorder::record(binding.m_traceName, flags,
+									 *Detail::CallSignatureFor<Ret, Params...>::get(), args);
 		}
-		Q_ASSERT(m_bindings.contains(id));
-		const auto binding = m_bindings[id];
+	}
+	static void callBlocking(const Detail::Binding &binding, void (*function)(void *),
+							 void *context);
+	template <typename Func>
+	static void callBlocking(const Detail::Binding &binding, Func &func)
+	{
+		callBlocking(binding, &Detail::callFunctor<Func>, &func);
+	}
+
+	// arguments are passed on by address, so they aren't copied unless the callback takes them
+	// by value; rvalues may be moved from (see Detail::MovableMask)
+	template <typename Ret, typename... Params>
+	static Ret invokeBinding(const Detail::Binding &binding, const Qt::ConnectionType type,
+							 Params &&... params)
+	{
 		Ret ret;
-		if (binding.m_object)
+		const Detail::CallPlan *plan =
+			binding.m_object->plan(Detail::CallSignatureFor<Ret, Params...>::get());
+		if (plan->valid)
 		{
 			void *args[] = {&ret,
 							const_cast<void *>(reinterpret_cast<const void *>(&params))...};
-			callSlotObject(binding, args);
+			callSlotObject(binding, type, args, Detail::MovableMask<Params...>::value, *plan);
 		}
-		else
+		return ret;
+	}
+	template <typename... Params>
+	static void invokeBindingVoid(const Detail::Binding &binding, const Qt::ConnectionType type,
+								  Params &&... params)
+	{
+		const Detail::CallPlan *plan =
+			binding.m_object->plan(Detail::CallSignatureFor<void, Params...>::get());
+		if (plan->valid)
+		{
+			void *args[] = {0, const_cast<void *>(reinterpret_cast<const void *>(&params))...};
+			callSlotObject(binding, type, args, Detail::MovableMask<Params...>::value, *plan);
+		}
+	}
+
+	// the call owns its arguments and runs once, so the callback may take them over
+	template <typename Ret, typename... Params, std::size_t... S>
+	static Ret invokeTuple(const Detail::Binding &binding, std::tuple<Params...> &params,
+						   Detail::Sequence<S...>)
+	{
+		return invokeBinding<Ret>(binding, Qt::DirectConnection,
+								  std::move(std::get<S>(params))...);
+	}
+	template <typename... Params, std::size_t... S>
+	static void invokeTupleVoid(const Detail::Binding &binding, std::tuple<Params...> &params,
+								Detail::Sequence<S...>)
+	{
+		invokeBindingVoid(binding, Qt::DirectConnection, std::move(std::get<S>(params))...);
+	}
+
+	template <typename Ret, typename... Params, std::size_t... S>
+	static void reportTuple(QFutureInterface<Ret> &iface, const Detail::Binding &binding,
+							std::tuple<Params...> &params, Detail::Sequence<S...> sequence)
+	{
+		iface.reportResult(invokeTuple<Ret>(binding, params, sequence));
+	}
+	template <typename... Params, std::size_t... S>
+	static void reportTuple(QFutureInterface<void> &, const Detail::Binding &binding,
+							std::tuple<Params...> &params, Detail::Sequence<S...> sequence)
+	{
+		invokeTupleVoid(binding, params, sequence);
+	}
+	template <typename Ret, typename... Params>
+	static void reportCall(QFutureInterface<Ret> &iface, const Detail::Binding &binding,
+						   Params &&... params)
+	{
+		iface.reportResult(
+			invokeBinding<Ret>(binding, Qt::DirectConnection, std::forward<Params>(params)...));
+	}
+	template <typename... Params>
+	static void reportCall(QFutureInterface<void> &, const Detail::Binding &binding,
+						   Params &&... params)
+	{
+		invokeBindingVoid(binding, Qt::DirectConnection, std::forward<Params>(params)...);
+	}
+	template <typename Ret, typename Item>
+	static void reportItem(QFutureInterface<Ret> &iface, const Detail::Binding &binding,
+						   Item &&item, const int index)
+	{
+		iface.reportResult(
+			invokeBinding<Ret>(binding, Qt::DirectConnection, std::forward<Item>(item)), index);
+	}
+	template <typename Item>
+	static void reportItem(QFutureInterface<void> &, const Detail::Binding &binding, Item &&item,
+						   const int)
+	{
+		invokeBindingVoid(binding, Qt::DirectConnection, std::forward<Item>(item));
+	}
+	template <typename Ret, typename... Params>
+	static void gatherCall(Detail::Gather<Ret> &gather, const int index,
+						   const Detail::Binding &binding, const Params &... params)
+	{
+		gather.set(index, invokeBinding<Ret>(binding, Qt::DirectConnection, params...));
+	}
+	template <typename... Params>
+	static void gatherCall(Detail::Gather<void> &gather, const int index,
+						   const Detail::Binding &binding, const Params &... params)
+	{
+		invokeBindingVoid(binding, Qt::DirectConnection, params...);
+		gather.set(index);
+	}
+
+	template <typename Ret, typename... Params>
+	Ret waitInternal(const Detail::CallbackId &id, Params &&... params)
+	{
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::wait", "No binding found for the given callback ID");
+		return waitCached<Ret>(*binding, Detail::IsCacheable<Ret, Params...>(),
+							   Detail::decayArgument(std::forward<Params>(params))...);
+	}
+	template <typename Ret, typename... Params>
+	static Ret waitCached(const Detail::Binding &binding, std::true_type, Params &&... params)
+	{
+		if (!binding.m_cache)
+		{
+			recordCall<Ret>(binding, 0, params...);
+			return waitBinding<Ret>(binding, std::true_type(), std::forward<Params>(params)...);
+		}
+		Ret ret;
+		if (binding.m_cache->find(ret, params...))
 		{
-			const QMetaMethod method = binding.m_method;
-			checkParameterCount(method, sizeof...(Params));
-			checkReturnType(method, qMetaTypeId<Ret>());
-			const auto retArg = QReturnArgument<Ret>(
-				QMetaType::typeName(qMetaTypeId<Ret>()),
-				ret); // because Q_RETURN_ARG doesn't work with templates...
-			method.invoke(const_cast<QObject *>(binding.m_receiver),
-						  connectionType(binding.m_receiver), retArg, Q_ARG(Params, params)...);
+			return ret;
 		}
+		recordCall<Ret>(binding, 0, params...);
+		// the call may move from the arguments
+		std::tuple<typename Detail::CacheKey<Params>::type...> key(params...);
+		ret = waitBinding<Ret>(binding, std::true_type(), std::forward<Params>(params)...);
+		binding.m_cache->insert(ret, std::move(key));
 		return ret;
 	}
-	template <typename... Params> void waitVoidInternal(const QString &id, Params... params)
+	template <typename Ret, typename... Params>
+	static Ret waitCached(const Detail::Binding &binding, std::false_type, Params &&... params)
+	{
+		recordCall<Ret>(binding, 0, params...);
+		return waitBinding<Ret>(binding, std::false_type(), std::forward<Params>(params)...);
+	}
+	/// Shares a call that's already running if the binding allows that
+	template <typename Ret, typename... Params>
+	static Ret waitBinding(const Detail::Binding &binding, std::true_type, Params &&... params)
 	{
-		if (!m_bindings.contains(id) && m_parent)
+		if (!binding.m_inFlight || connectionType(binding) == Qt::DirectConnection)
 		{
-			m_parent->waitVoidInternal<Params...>(id, params...);
+			return waitBinding<Ret>(binding, std::false_type(),
+									std::forward<Params>(params)...);
+		}
+		const Detail::TracedWait trace(binding);
+		QFuture<Ret> shared =
+			startRequest<Ret>(binding, std::true_type(), std::forward<Params>(params)...);
+		shared.waitForFinished();
+		return Detail::resultOrDefault(shared);
+	}
+	template <typename Ret, typename... Params>
+	static Ret waitBinding(const Detail::Binding &binding, std::false_type, Params &&... params)
+	{
+		const Detail::TracedWait trace(binding);
+		const Detail::CallTimer timer(binding);
+		const Qt::ConnectionType type = connectionType(binding);
+		Ret ret = invokeBinding<Ret>(binding, type, std::forward<Params>(params)...);
+		timer.finished(type != Qt::DirectConnection);
+		return ret;
+	}
+	template <typename... Params>
+	void waitVoidInternal(const Detail::CallbackId &id, Params &&... params)
+	{
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::wait", "No binding found for the given callback ID");
+		waitVoidRecorded(*binding, Detail::decayArgument(std::forward<Params>(params))...);
+	}
+	template <typename... Params>
+	static void waitVoidRecorded(const Detail::Binding &binding, Params &&... params)
+	{
+		recordCall<void>(binding, 0, params...);
+		waitVoidBinding(binding, Detail::AreCacheKeys<Params...>(),
+						std::forward<Params>(params)...);
+	}
+	template <typename... Params>
+	static void waitVoidBinding(const Detail::Binding &binding, std::true_type,
+								Params &&... params)
+	{
+		if (!binding.m_inFlight || connectionType(binding) == Qt::DirectConnection)
+		{
+			waitVoidBinding(binding, std::false_type(), std::forward<Params>(params)...);
 			return;
 		}
-		Q_ASSERT(m_bindings.contains(id));
-		const auto binding = m_bindings[id];
-		if (binding.m_object)
+		const Detail::TracedWait trace(binding);
+		startRequest<void>(binding, std::true_type(), std::forward<Params>(params)...)
+			.waitForFinished();
+	}
+	template <typename... Params>
+	static void waitVoidBinding(const Detail::Binding &binding, std::false_type,
+								Params &&... params)
+	{
+		const Detail::TracedWait trace(binding);
+		const Detail::CallTimer timer(binding);
+		const Qt::ConnectionType type = connectionType(binding);
+		invokeBindingVoid(binding, type, std::forward<Params>(params)...);
+		timer.finished(type != Qt::DirectConnection);
+	}
+
+	template <typename Ret, typename... Params>
+	static Detail::Request<Ret> startRequest(const Detail::Binding &binding, std::false_type,
+											 Params &&... params)
+	{
+		auto call = new RequestCall<Ret, typename std::decay<Params>::type...>(
+			binding, std::forward<Params>(params)...);
+		const Detail::Request<Ret> result(call->future(), call->m_continuations);
+		postRequest(call);
+		return result;
+	}
+	/// Joins an identical request that's still running instead if the binding allows that
+	template <typename Ret, typename... Params>
+	static Detail::Request<Ret> startRequest(const Detail::Binding &binding, std::true_type,
+											 Params &&... params)
+	{
+		if (!binding.m_inFlight)
 		{
-			void *args[] = {0, const_cast<void *>(reinterpret_cast<const void *>(&params))...};
-			callSlotObject(binding, args);
+			return startRequest<Ret>(binding, std::false_type(),
+									 std::forward<Params>(params)...);
+		}
+		QFuture<Ret> future;
+		QSharedPointer<Detail::Continuations> continuations;
+		if (binding.m_inFlight->join(future, continuations, params...))
+		{
+			return Detail::Request<Ret>(future, continuations);
+		}
+
+		// the call may move from the arguments
+		std::tuple<typename Detail::CacheKey<Params>::type...> key(params...);
+		auto call = new RequestCall<Ret, typename std::decay<Params>::type...>(
+			binding, std::forward<Params>(params)...);
+		call->m_joiners.reset(new Detail::Joiners);
+		future = call->future();
+		continuations = call->m_continuations;
+		if (Detail::InFlightCalls::share(binding.m_inFlight, future, continuations,
+										 call->m_joiners, std::move(key)))
+		{
+			// somebody else was quicker, this one was never posted
+			delete call;
 		}
 		else
 		{
-			const QMetaMethod method = binding.m_method;
-			checkParameterCount(method, sizeof...(Params));
-			method.invoke(const_cast<QObject *>(binding.m_receiver),
-						  connectionType(binding.m_receiver), Q_ARG(Params, params)...);
+			postRequest(call);
+		}
+		return Detail::Request<Ret>(future, continuations);
+	}
+
+	template <typename Ret, typename... Params>
+	Ret waitForInternal(const int msecs, bool *ok, const Detail::CallbackId &id,
+						Params &&... params)
+	{
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::waitFor", "No binding found for the given callback ID");
+		if (connectionType(*binding) == Qt::DirectConnection)
+		{
+			if (ok)
+			{
+				*ok = true;
+			}
+			return wait_t<Ret, Params...>(this)(id, std::forward<Params>(params)...);
+		}
+
+		recordCall<Ret>(*binding, 0, params...);
+		const Detail::TracedWait trace(*binding);
+		const Detail::CallTimer timer(*binding);
+		auto call = new WaitForCall<Ret, typename std::decay<Params>::type...>(
+			*binding, std::forward<Params>(params)...);
+		const Detail::TimedCall::Reference reference(call);
+		const bool finished = call->postAndWait(msecs);
+		if (ok)
+		{
+			*ok = finished;
+		}
+		if (!finished)
+		{
+			return Ret();
 		}
+		timer.finished(true);
+		return call->result();
 	}
 
 	template <typename Ret, typename... Params> struct wait_t
@@ -244,9 +759,9 @@ private:
 		{
 		}
 
-		Ret operator()(const QString &id, Params... params)
+		Ret operator()(const Detail::CallbackId &id, Params &&... params)
 		{
-			return m_bindable->waitInternal<Ret>(id, params...);
+			return m_bindable->waitInternal<Ret>(id, std::forward<Params>(params)...);
 		}
 	};
 	template <typename... Params> struct wait_t<void, Params...>
@@ -256,9 +771,9 @@ private:
 		{
 		}
 
-		void operator()(const QString &id, Params... params)
+		void operator()(const Detail::CallbackId &id, Params &&... params)
 		{
-			m_bindable->waitVoidInternal(id, params...);
+			m_bindable->waitVoidInternal(id, std::forward<Params>(params)...);
 		}
 	};
 
@@ -273,45 +788,250 @@ protected:
 	 */
 	template <typename Ret> Ret wait(const QString &id, ...);
 #else
-	template <typename Ret, typename... Params> Ret wait(const QString &id, Params... params)
+	template <typename Ret, typename... Params>
+	Ret wait(const Detail::CallbackId &id, Params &&... params)
+	{
+		return wait_t<Ret, Params...>(this)(id, std::forward<Params>(params)...);
+	}
+#endif
+
+#ifdef DOXYGEN
+	/**
+	 * @brief Like @ref wait, but gives up on receivers in other threads after msecs
+	 * @param msecs How long to wait, or -1 to wait as long as it takes
+	 * @param ok    If not null, set to whether the callback was called in time
+	 * @param id    The callback ID to call, as previously bound using @ref bind
+	 * @param ...   The parameters to pass to the callback
+	 * @returns The return value of the callback, or a default constructed value if it timed out
+	 *
+	 * A call that's still queued when the time is up is withdrawn, so the callback isn't called
+	 *at all. One that has already started runs to completion, but its result is discarded. The
+	 *parameters are copied (or moved) into the call, so it doesn't depend on the caller's stack.
+	 *Waiting for room in a full queue (see @ref setQueueLimit) counts toward msecs, and a
+	 *withdrawn call stops counting toward that queue's limit right away. Receivers in the
+	 *calling thread are called directly, without a limit.
+	 */
+	template <typename Ret> Ret waitFor(const int msecs, bool *ok, const QString &id, ...);
+#else
+	template <typename Ret, typename... Params>
+	Ret waitFor(const int msecs, bool *ok, const Detail::CallbackId &id, Params &&... params)
 	{
-		return wait_t<Ret, Params...>(this)(id, params...);
+		return waitForInternal<Ret>(msecs, ok, id, std::forward<Params>(params)...);
 	}
 #endif
 
 #ifdef DOXYGEN
 	/**
 	 * @brief Creates a QFuture and returns immediately
+	 *
+	 * If the receiver lives in another thread the call is posted to that thread's event loop,
+	 *and the future is completed from there; no thread is blocked while it's pending.
+	 *Canceling the future before the receiver's thread gets to the call withdraws it, the
+	 *callback isn't called then.
+	 *
+	 * The result can be chained with Detail::Request::then instead of being waited for:
+	 * @code
+	 * request<QString>("AskForName").then(this, [this](const QString &name)
+	 * {
+	 *     return request<bool>("Confirm", tr("Use %1?").arg(name));
+	 * }).then(this, [](bool confirmed) { ... });
+	 * @endcode
 	 * @warning If the receiver is in the same thread as the caller, this will still be a
 	 * blocking request
 	 * @param id  The callback ID to call, as previously bound using @ref bind
 	 * @param ... The parameters to pass to the callback
 	 * @see wait
 	 */
-	template <typename Ret> QFuture<Ret> request(const QString &id, ...);
+	template <typename Ret> Detail::Request<Ret> request(const QString &id, ...);
 #else
 	template <typename Ret, typename... Params>
-	QFuture<Ret> request(const QString &id, Params... params)
+	Detail::Request<Ret> request(const Detail::CallbackId &id, Params &&... params)
 	{
-		if (!m_bindings.contains(id) && m_parent)
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::request", "No binding found for the given callback ID");
+		recordCall<Ret>(*binding, Detail::Recorder::Request, params...);
+		if (connectionType(*binding) == Qt::DirectConnection)
 		{
-			return m_parent->request<Ret, Params...>(id, params...);
+			const Detail::CallTimer timer(*binding);
+			QFutureInterface<Ret> iface;
+			iface.reportStarted();
+			reportCall(iface, *binding, std::forward<Params>(params)...);
+			iface.reportFinished();
+			timer.finished(false);
+			QSharedPointer<Detail::Continuations> continuations(new Detail::Continuations);
+			continuations->close();
+			return Detail::Request<Ret>(iface.future(), continuations);
 		}
-		Q_ASSERT(m_bindings.contains(id));
-		const auto binding = m_bindings[id];
-		if (connectionType(binding.m_receiver) == Qt::DirectConnection)
+		else
 		{
-			QFutureInterface<Ret> *iface = new QFutureInterface<Ret>();
-			QFuture<Ret> future = iface->future();
-			iface->reportStarted();
-			iface->reportResult(wait<Ret>(id, params...));
-			iface->reportFinished();
-			return future;
+			return startRequest<Ret>(*binding, Detail::AreCacheKeys<Params...>(),
+									 std::forward<Params>(params)...);
 		}
-		else
+	}
+#endif
+
+	/**
+	 * @brief Calls a callback once for every item of a range
+	 * @param id      The callback ID to call, as previously bound using @ref bind
+	 * @param items   Anything that can be iterated over; each item is passed as the callback's
+	 *only argument
+	 * @param options How many calls may be in flight at once, how big the chunks are, and
+	 *whether results are reported in item order or as they come in
+	 * @returns A future with one result per item (available one by one, see
+	 *QFuture::resultAt), and progress counting the handled items
+	 *
+	 * The items are copied into the request up front. For a receiver in another thread only a
+	 *few calls are queued, each handling a chunk of items before it lets the receiver's event
+	 *loop get to other events, instead of one call per item. Canceling the future stops it
+	 *after the item that's running. Receivers in the calling thread are called for all items
+	 *right away.
+	 */
+	template <typename Ret, typename Range>
+	Detail::Request<Ret> requestMany(const Detail::CallbackId &id, const Range &items,
+									 const Detail::BulkOptions &options = Detail::BulkOptions())
+	{
+		typedef typename std::decay<decltype(*std::begin(items))>::type Item;
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::requestMany",
+				   "No binding found for the given callback ID");
+		if (connectionType(*binding) == Qt::DirectConnection)
+		{
+			QFutureInterface<Ret> iface;
+			iface.reportStarted();
+			int index = 0;
+			for (const Item &item : items)
+			{
+				recordCall<Ret>(*binding, Detail::Recorder::Request, item);
+				const Detail::CallTimer timer(*binding);
+				reportItem(iface, *binding, item, index++);
+				timer.finished(false);
+			}
+			iface.reportFinished();
+			QSharedPointer<Detail::Continuations> continuations(new Detail::Continuations);
+			continuations->close();
+			return Detail::Request<Ret>(iface.future(), continuations);
+		}
+
+		QVector<Item> copies;
+		for (const Item &item : items)
 		{
-			return (new RequestRunner<Ret, Params...>(id, this, params...))->start();
+			recordCall<Ret>(*binding, Detail::Recorder::Request, item);
+			copies.append(item);
 		}
+		auto call = new BulkCall<Ret, Item>(*binding, std::move(copies), options);
+		const Detail::Request<Ret> result(call->future(), call->m_continuations);
+		call->start();
+		return result;
+	}
+
+	/**
+	 * @brief Calls every binding of a callback ID at once
+	 * @param id  The callback ID to call, as bound using @ref bind and @ref addBinding
+	 * @param ... The parameters to pass to the callbacks; each callback gets its own copy
+	 * @returns The results, in the order the bindings were added (nothing for void)
+	 *
+	 * Calls to receivers in other threads are all posted before the ones in the calling thread
+	 *are made, so they run in parallel, and the whole call takes about as long as the slowest
+	 *callback instead of as long as all of them together. If any of the calls is canceled
+	 *(because its receiver was deleted), so is the returned request.
+	 */
+	template <typename Ret, typename... Params>
+	Detail::Request<typename Detail::Gather<Ret>::Result>
+	requestAll(const Detail::CallbackId &id, const Params &... params)
+	{
+		const Detail::BindingRef binding = findBinding(id);
+		Q_ASSERT_X(binding, "Bindable::requestAll",
+				   "No binding found for the given callback ID");
+		recordCall<Ret>(*binding, Detail::Recorder::Request | Detail::Recorder::AllBindings,
+						params...);
+		QVarLengthArray<const Detail::Binding *, 8> bindings;
+		for (const Detail::Binding *b = &*binding; b; b = b->m_next.data())
+		{
+			bindings.prepend(b);
+		}
+
+		QSharedPointer<Detail::Gather<Ret>> gather(new Detail::Gather<Ret>(bindings.size()));
+		for (int i = 0; i < bindings.size(); ++i)
+		{
+			const Detail::Binding &b = *bindings[i];
+			if (connectionType(b) != Qt::DirectConnection)
+			{
+				auto call =
+					new RequestCall<Ret, typename std::decay<Params>::type...>(b, params...);
+				call->m_continuations->add(
+					new Detail::GatherCall<Ret>(call->future(), gather, i));
+				postRequest(call);
+			}
+		}
+		for (int i = 0; i < bindings.size(); ++i)
+		{
+			const Detail::Binding &b = *bindings[i];
+			if (connectionType(b) == Qt::DirectConnection)
+			{
+				gatherCall(*gather, i, b, params...);
+			}
+		}
+		return gather->request();
+	}
+	/// Blocking version of @ref requestAll, returns nothing if any of the calls was canceled
+	template <typename Ret, typename... Params>
+	typename Detail::Gather<Ret>::Result waitAll(const Detail::CallbackId &id,
+												 const Params &... params)
+	{
+		QFuture<typename Detail::Gather<Ret>::Result> all = requestAll<Ret>(id, params...);
+		all.waitForFinished();
+		return Detail::resultOrDefault(all);
+	}
+	/**
+	 * @brief Like @ref waitAll, but folds the results into one value
+	 * @param reduce Called as reduce(result, value) for each result, in binding order
+	 * @param result The initial value
+	 */
+	template <typename Ret, typename Result, typename Reduce, typename... Params>
+	Result waitAllReduced(Reduce reduce, Result result, const Detail::CallbackId &id,
+						  const Params &... params)
+	{
+		for (const Ret &value : waitAll<Ret>(id, params...))
+		{
+			reduce(result, value);
+		}
+		return result;
+	}
+
+#if defined(__cpp_impl_coroutine) || defined(DOXYGEN)
+	/**
+	 * @brief Like @ref request, but to be used with co_await from a C++20 coroutine
+	 *
+	 * @code
+	 * const QString fileName = co_await askAsync<QString>("GetFileName", tr("Open"));
+	 * @endcode
+	 *
+	 * The coroutine is suspended while the callback runs on the receiver's thread, and
+	 *resumed on the calling thread, through its event loop, once the result is there. No
+	 *thread waits in the meantime, so any number of these can be pending at once. If the
+	 *request is canceled (for example because the receiver was deleted) the result is a
+	 *default constructed value.
+	 *
+	 * Only available when the code including this header is compiled as C++20 or later.
+	 */
+	template <typename Ret, typename... Params>
+	Detail::RequestAwaiter<Ret> askAsync(const Detail::CallbackId &id, Params &&... params)
+	{
+		return askAsyncOn<Ret>(Detail::Dispatcher::forThread(QThread::currentThread()), id,
+							   std::forward<Params>(params)...);
+	}
+	/**
+	 * @brief Like @ref askAsync, but resumes the coroutine on the thread of context
+	 *
+	 * If context is deleted before then, the coroutine is destroyed instead of resumed.
+	 */
+	template <typename Ret, typename... Params>
+	Detail::RequestAwaiter<Ret> askAsyncOn(const QObject *context, const Detail::CallbackId &id,
+										   Params &&... params)
+	{
+		// the same call request() makes, with single-flight, recording and metrics
+		return Detail::RequestAwaiter<Ret>(request<Ret>(id, std::forward<Params>(params)...),
+										   context);
 	}
 #endif
 };
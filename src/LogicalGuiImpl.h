@@ -1,80 +1,539 @@
 #pragma once
 
+#include <QObject>
+#include <QMetaMethod>
 #include <QFuture>
-#include <QThreadPool>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QSharedPointer>
 #include <tuple>
 
+#include "Dispatcher.h"
+#include "Executor.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "ResultCache.h"
+#include "InFlightCalls.h"
+#include "SlotObject.h"
+
 class Bindable;
 
 namespace Detail
 {
-template <std::size_t... a> struct Sequence
+/// Optional behaviour of a binding, see Bindable::bind
+struct BindingOptions
 {
+	/**
+	 * @brief If above 0, results of Bindable::wait are cached per argument values
+	 *
+	 * Only for callbacks that always return the same result for the same arguments. Calls
+	 * whose argument types can't be hashed or compared are never cached.
+	 */
+	int cacheSize = 0;
+	/// How long cached results stay valid in msecs, or -1 for as long as they're not evicted
+	int cacheTtl = -1;
+	/**
+	 * @brief Let calls to a receiver in another thread share the result of an identical call
+	 *
+	 * A Bindable::wait or Bindable::request with the same arguments as a call that's still
+	 * running (or queued) doesn't make a call of its own, but gets that call's result. Like
+	 * with caching, calls with argument types that can't be hashed or compared always make
+	 * their own call.
+	 *
+	 * Every caller still gets a future of its own, so canceling it only cancels that caller's
+	 * share; the call itself is only skipped if all of them have canceled before it runs.
+	 */
+	bool singleFlight = false;
+	/// The default priority of calls to a receiver in another thread, see PriorityScope
+	CallPriority priority = NormalPriority;
+	/**
+	 * @brief Run calls on this executor instead of the receiver's thread
+	 *
+	 * For example a PoolExecutor for CPU heavy callbacks, or a StrandExecutor for ones that
+	 * have to run one at a time. Not owned by the binding, see Executor.
+	 */
+	Executor *executor = nullptr;
 };
-template <std::size_t N, std::size_t... S>
-struct SequenceGenerator : SequenceGenerator<N - 1, N - 1, S...>
+
+struct Binding
 {
+	Binding(const QObject *receiver, const QMetaMethod &method)
+		: m_receiver(receiver), m_method(method),
+		  m_object(method.isValid() ? new MetaMethodSlotObject(method) : nullptr)
+	{
+	}
+	/// Takes over the initial reference of object
+	Binding(const QObject *receiver, SlotObjectBase *object)
+		: m_receiver(receiver), m_object(object)
+	{
+	}
+	Binding()
+	{
+	}
+	Binding(const Binding &other)
+		: m_receiver(other.m_receiver), m_method(other.m_method), m_object(other.m_object),
+		  m_traceName(other.m_traceName), m_next(other.m_next), m_cache(other.m_cache),
+		  m_inFlight(other.m_inFlight), m_priority(other.m_priority),
+		  m_executor(other.m_executor)
+#ifdef LOGICALGUI_METRICS
+		  ,
+		  m_metrics(other.m_metrics)
+#endif
+	{
+		if (m_object)
+		{
+			m_object->ref();
+		}
+	}
+	Binding &operator=(const Binding &other)
+	{
+		if (other.m_object)
+		{
+			other.m_object->ref();
+		}
+		if (m_object)
+		{
+			m_object->destroyIfLastRef();
+		}
+		m_receiver = other.m_receiver;
+		m_method = other.m_method;
+		m_object = other.m_object;
+		m_traceName = other.m_traceName;
+		m_next = other.m_next;
+		m_cache = other.m_cache;
+		m_inFlight = other.m_inFlight;
+		m_priority = other.m_priority;
+		m_executor = other.m_executor;
+#ifdef LOGICALGUI_METRICS
+		m_metrics = other.m_metrics;
+#endif
+		return *this;
+	}
+	~Binding()
+	{
+		if (m_object)
+		{
+			m_object->destroyIfLastRef();
+		}
+	}
+	const QObject *m_receiver = nullptr;
+	QMetaMethod m_method;
+	SlotObjectBase *m_object = nullptr;
+	/// The callback ID as interned by @ref Tracer, set when the binding is bound
+	int m_traceName = -1;
+	/// Bindings added to the same callback ID before this one, see Bindable::addBinding
+	QSharedPointer<const Binding> m_next;
+	/// Shared by every copy of the binding, see BindingOptions::cacheSize
+	QSharedPointer<ResultCache> m_cache;
+	/// Shared by every copy of the binding, see BindingOptions::singleFlight
+	QSharedPointer<InFlightCalls> m_inFlight;
+	CallPriority m_priority = NormalPriority;
+	Executor *m_executor = nullptr;
+#ifdef LOGICALGUI_METRICS
+	/// Set when the binding is bound to a callback ID
+	CallbackMetrics *m_metrics = nullptr;
+#endif
 };
-template <std::size_t... S> struct SequenceGenerator<0, S...>
+
+/// The priority of a call to binding made from the current thread
+inline CallPriority callPriority(const Binding &binding)
+{
+	const int scoped = PriorityScope::current();
+	return scoped >= 0 ? CallPriority(scoped) : binding.m_priority;
+}
+/// Sets up a call to binding to be posted the way the binding says
+inline void prepareCall(DispatchCall *call, const Binding &binding)
+{
+	call->m_priority = callPriority(binding);
+	call->m_executor = binding.m_executor;
+}
+
+/**
+ * @brief Records a call to a binding in its @ref CallbackMetrics
+ *
+ * Starts timing on construction. Compiles to nothing unless LOGICALGUI_METRICS is defined.
+ */
+class CallTimer
 {
-	typedef Sequence<S...> type;
+public:
+#ifdef LOGICALGUI_METRICS
+	explicit CallTimer(const Binding &binding)
+		: m_metrics(binding.m_metrics), m_start(CallbackMetrics::now())
+	{
+	}
+	/// The receiver thread started running the call
+	void started() const
+	{
+		if (m_metrics)
+		{
+			m_metrics->recordQueued(CallbackMetrics::now() - m_start);
+		}
+	}
+	void finished(const bool crossThread) const
+	{
+		if (m_metrics)
+		{
+			m_metrics->recordCall(crossThread, CallbackMetrics::now() - m_start);
+		}
+	}
+
+private:
+	CallbackMetrics *m_metrics;
+	qint64 m_start;
+#else
+	explicit CallTimer(const Binding &)
+	{
+	}
+	void started() const
+	{
+	}
+	void finished(const bool) const
+	{
+	}
+#endif
+};
+
+/// Traces a wait() from construction to destruction
+class TracedWait
+{
+	Q_DISABLE_COPY(TracedWait)
+public:
+	explicit TracedWait(const Binding &binding)
+		: m_name(Tracer::isEnabled() ? binding.m_traceName : -1)
+	{
+		if (m_name >= 0)
+		{
+			Tracer::record(Tracer::WaitBegin, m_name, 0);
+		}
+	}
+	~TracedWait()
+	{
+		if (m_name >= 0)
+		{
+			Tracer::record(Tracer::WaitEnd, m_name, 0);
+		}
+	}
+
+private:
+	int m_name;
 };
 
-template <typename Ret, typename... Params>
-class BaseRequestRunner : public QFutureInterface<Ret>, public QRunnable
+/// Traces a call being posted to the receiver's thread on construction, and it running there
+class TracedDispatch
 {
 public:
-	explicit BaseRequestRunner(const QString id, Bindable *parent, Params... params)
-		: m_id(id), m_parent(parent), m_params(std::make_tuple(params...))
+	explicit TracedDispatch(const Binding &binding)
+		: m_name(binding.m_traceName), m_call(Tracer::isEnabled() ? Tracer::newCall() : 0)
+	{
+		if (m_call)
+		{
+			Tracer::record(Tracer::Enqueue, m_name, m_call);
+		}
+	}
+	void started() const
+	{
+		if (m_call)
+		{
+			Tracer::record(Tracer::Start, m_name, m_call);
+		}
+	}
+	void finished() const
 	{
+		if (m_call)
+		{
+			Tracer::record(Tracer::Finish, m_name, m_call);
+		}
 	}
 
-	QFuture<Ret> start()
+private:
+	int m_name;
+	quint64 m_call;
+};
+
+/**
+ * @brief A blocking call that the caller may give up on
+ *
+ * Owns copies of its arguments, and is shared between the caller and the receiver's
+ * @ref Dispatcher, so either side can be done with it first. If the caller gives up while the
+ * call is still queued, the dispatcher skips it.
+ */
+class TimedCall : public DispatchCall
+{
+	Q_DISABLE_COPY(TimedCall)
+public:
+	explicit TimedCall(const Binding &binding);
+	virtual ~TimedCall()
 	{
-		this->setRunnable(this);
-		// this->setThreadPool(QThreadPool::globalInstance());
-		this->reportStarted();
-		QFuture<Ret> future = this->future();
-		QThreadPool::globalInstance()->start(this);
-		return future;
 	}
 
-	void run() override
+	/// The caller's reference; results may only be read while it's held
+	class Reference
 	{
-		if (this->isCanceled())
+	public:
+		explicit Reference(TimedCall *call) : m_call(call)
 		{
-			this->reportFinished();
-			return;
+		}
+		~Reference()
+		{
+			m_call->deref();
 		}
 
-		this->reportResult(runFunctor(m_id, m_parent, m_params));
-		this->reportFinished();
+	private:
+		TimedCall *m_call;
+	};
+
+	/**
+	 * @brief Posts the call to the receiver's thread (or executor) and waits for it
+	 * @param msecs How long to wait, or -1 for no limit
+	 * @returns True if the call ran to completion in time
+	 */
+	bool postAndWait(const int msecs);
+
+protected:
+	virtual void run() = 0;
+
+private:
+	enum State
+	{
+		Pending,
+		Running,
+		Finished,
+		Dropped
+	};
+	std::atomic<int> m_state;
+	QAtomicInt m_ref;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	CallTimer m_timer;
+	TracedDispatch m_trace;
+
+	static void dispatch(DispatchCall *call, bool receiverAlive);
+	void finish(const State state);
+	void deref();
+};
+
+/**
+ * @brief A call that, once it's done, posts other calls to their receivers' threads
+ *
+ * Used to continue on another thread without anyone waiting: the continuations are posted
+ * when the call is destroyed, whether it ran or was dropped.
+ */
+class ContinuedCall : public DispatchCall
+{
+public:
+	ContinuedCall(const QObject *receiver, Function function)
+		: DispatchCall(receiver, function), m_continuations(new Continuations)
+	{
+	}
+	virtual ~ContinuedCall()
+	{
+		m_continuations->close();
+	}
+
+	QSharedPointer<Continuations> m_continuations;
+};
+
+/**
+ * @brief A request that runs in the receiver's thread and completes its future from there
+ *
+ * Posted to the receiver thread's @ref Dispatcher (or the binding's @ref Executor), so the
+ * caller doesn't need a thread of its own while waiting. If it's dropped without having run
+ * (for example because the receiver was deleted) the future is canceled instead of being left
+ * pending forever.
+ */
+template <typename Ret, typename... Params> class BaseRequestCall : public ContinuedCall
+{
+public:
+	/// The arguments are moved into the request if they're rvalues, and copied otherwise
+	template <typename... Args>
+	explicit BaseRequestCall(const Binding &binding, Args &&... args)
+		: ContinuedCall(binding.m_receiver, &dispatch), m_binding(binding),
+		  m_params(std::forward<Args>(args)...), m_timer(binding), m_trace(binding)
+	{
+		m_droppable = true;
+		prepareCall(this, binding);
+		m_iface.reportStarted();
 	}
+	virtual ~BaseRequestCall()
+	{
+		if (!m_iface.isFinished())
+		{
+			m_iface.reportCanceled();
+			m_iface.reportFinished();
+		}
+	}
+
+	QFuture<Ret> future()
+	{
+		return m_iface.future();
+	}
+
+	/// Set for a request other callers may join, see BindingOptions::singleFlight
+	QSharedPointer<Joiners> m_joiners;
 
 protected:
-	QString m_id;
-	Bindable *m_parent;
+	/// Calls the binding and reports its result (if any) to iface
+	virtual void runFunctor(QFutureInterface<Ret> &iface, const Binding &binding,
+							std::tuple<Params...> &params) = 0;
+
+private:
+	QFutureInterface<Ret> m_iface;
+	Binding m_binding;
 	std::tuple<Params...> m_params;
+	CallTimer m_timer;
+	TracedDispatch m_trace;
+
+	void run()
+	{
+		if (m_iface.isCanceled() || (m_joiners && m_joiners->abandonIfCanceled()))
+		{
+			m_iface.reportCanceled();
+			m_iface.reportFinished();
+			return;
+		}
+		m_timer.started();
+		m_trace.started();
+		runFunctor(m_iface, m_binding, m_params);
+		m_iface.reportFinished();
+		m_trace.finished();
+		m_timer.finished(true);
+	}
 
-	virtual Ret runFunctor(const QString &id, Bindable *parent,
-						   std::tuple<Params...> params) = 0;
+	static void dispatch(DispatchCall *call, bool receiverAlive)
+	{
+		BaseRequestCall *self = static_cast<BaseRequestCall *>(call);
+		if (receiverAlive)
+		{
+			self->run();
+		}
+		delete self;
+	}
 };
 
-struct Binding
+/// How Bindable::requestMany spreads its calls over the receiver's event loop
+struct BulkOptions
 {
-	Binding(const QObject *receiver, const QMetaMethod &method)
-		: m_receiver(receiver), m_method(method)
+	/// How many chunks may be queued or running at the same time
+	int maxInFlight = 4;
+	/// How many items one queued call handles before it lets other events through
+	int chunkSize = 16;
+	/// If true result i belongs to item i, otherwise results are reported as they come in
+	bool ordered = true;
+};
+
+/**
+ * @brief Calls a binding once per item, through a bounded number of queued calls
+ *
+ * Instead of posting one call per item, up to @ref BulkOptions::maxInFlight workers are posted
+ * to the receiver's thread. Each one claims the next chunk of items, calls the binding for
+ * them, and posts itself again while items are left. The last worker to go away deletes the
+ * call, which finishes the future, or cancels it if not all items were handled.
+ */
+template <typename Ret, typename Item> class BaseBulkCall
+{
+	Q_DISABLE_COPY(BaseBulkCall)
+public:
+	BaseBulkCall(const Binding &binding, QVector<Item> items, const BulkOptions &options)
+		: m_continuations(new Continuations), m_binding(binding), m_items(std::move(items)),
+		  m_options(options), m_nextItem(0), m_handled(0), m_workers(0)
 	{
+		m_options.chunkSize = qMax(1, m_options.chunkSize);
+		m_iface.reportStarted();
+		m_iface.setProgressRange(0, m_items.size());
 	}
-	Binding(const QObject *receiver, QtPrivate::QSlotObjectBase *object)
-		: m_receiver(receiver), m_object(object)
+	virtual ~BaseBulkCall()
 	{
+		if (m_handled.load() < m_items.size())
+		{
+			m_iface.reportCanceled();
+		}
+		m_iface.reportFinished();
+		m_continuations->close();
 	}
-	Binding()
+
+	QFuture<Ret> future()
 	{
+		return m_iface.future();
+	}
+	QSharedPointer<Continuations> m_continuations;
+
+	/// Posts the workers; the call may be gone by the time this returns
+	void start()
+	{
+		const int chunks = (m_items.size() + m_options.chunkSize - 1) / m_options.chunkSize;
+		const int workers = qBound(1, m_options.maxInFlight, qMax(1, chunks));
+		m_workers.store(workers);
+		for (int i = 0; i < workers; ++i)
+		{
+			Dispatcher::postToReceiver(new Worker(this));
+		}
+	}
+
+protected:
+	/// Calls the binding with item and reports the result (if any) to iface at index
+	virtual void runFunctor(QFutureInterface<Ret> &iface, const Binding &binding, Item &item,
+							const int index) = 0;
+
+private:
+	struct Worker : public DispatchCall
+	{
+		explicit Worker(BaseBulkCall *bulk)
+			: DispatchCall(bulk->m_binding.m_receiver, &dispatch), m_bulk(bulk)
+		{
+			prepareCall(this, bulk->m_binding);
+		}
+		BaseBulkCall *m_bulk;
+	};
+
+	QFutureInterface<Ret> m_iface;
+	Binding m_binding;
+	QVector<Item> m_items;
+	BulkOptions m_options;
+	std::atomic<int> m_nextItem;
+	std::atomic<int> m_handled;
+	std::atomic<int> m_workers;
+
+	/// Handles the next chunk of items, returns whether any are left after it
+	bool runChunk()
+	{
+		const int count = m_items.size();
+		if (m_iface.isCanceled())
+		{
+			return false;
+		}
+		const int begin = m_nextItem.fetch_add(m_options.chunkSize);
+		if (begin >= count)
+		{
+			return false;
+		}
+		const int end = qMin(count, begin + m_options.chunkSize);
+		int i = begin;
+		for (; i < end && !m_iface.isCanceled(); ++i)
+		{
+			const CallTimer timer(m_binding);
+			runFunctor(m_iface, m_binding, m_items[i], m_options.ordered ? i : -1);
+			timer.finished(true);
+		}
+		m_iface.setProgressValue(m_handled.fetch_add(i - begin) + i - begin);
+		return i == end && end < count;
+	}
+
+	static void dispatch(DispatchCall *call, bool receiverAlive)
+	{
+		Worker *worker = static_cast<Worker *>(call);
+		BaseBulkCall *self = worker->m_bulk;
+		if (receiverAlive && self->runChunk())
+		{
+			Dispatcher::postToReceiver(worker);
+			return;
+		}
+		delete worker;
+		if (self->m_workers.fetch_sub(1) == 1)
+		{
+			delete self;
+		}
 	}
-	const QObject *m_receiver;
-	QMetaMethod m_method;
-	QtPrivate::QSlotObjectBase *m_object = nullptr;
 };
 }
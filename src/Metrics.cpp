@@ -0,0 +1,115 @@
+#include "Metrics.h"
+
+#ifdef LOGICALGUI_METRICS
+
+#include <QMutex>
+#include <chrono>
+
+namespace Detail
+{
+typedef QHash<QString, CallbackMetrics *> MetricsMap;
+Q_GLOBAL_STATIC(MetricsMap, metrics)
+static QMutex s_metricsMutex;
+
+CallbackMetrics::CallbackMetrics()
+{
+	clear();
+}
+
+CallbackMetrics *CallbackMetrics::forId(const QString &id)
+{
+	QMutexLocker locker(&s_metricsMutex);
+	CallbackMetrics *&entry = (*metrics())[id];
+	if (!entry)
+	{
+		entry = new CallbackMetrics;
+	}
+	return entry;
+}
+
+QHash<QString, CallbackStatistics> CallbackMetrics::snapshot()
+{
+	QMutexLocker locker(&s_metricsMutex);
+	QHash<QString, CallbackStatistics> result;
+	for (auto it = metrics()->constBegin(); it != metrics()->constEnd(); ++it)
+	{
+		const CallbackMetrics *entry = it.value();
+		CallbackStatistics statistics;
+		statistics.sameThreadCalls = entry->m_sameThread.load(std::memory_order_relaxed);
+		statistics.crossThreadCalls = entry->m_crossThread.load(std::memory_order_relaxed);
+		if (statistics.sameThreadCalls + statistics.crossThreadCalls == 0)
+		{
+			continue;
+		}
+		statistics.latencyHistogram = histogram(entry->m_latency);
+		statistics.queueingHistogram = histogram(entry->m_queued);
+		result.insert(it.key(), statistics);
+	}
+	return result;
+}
+
+void CallbackMetrics::reset()
+{
+	// bindings keep pointing to their counters, so only zero them
+	QMutexLocker locker(&s_metricsMutex);
+	for (CallbackMetrics *entry : *metrics())
+	{
+		entry->clear();
+	}
+}
+
+qint64 CallbackMetrics::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CallbackMetrics::recordCall(const bool crossThread, const qint64 nsecs)
+{
+	(crossThread ? m_crossThread : m_sameThread).fetch_add(1, std::memory_order_relaxed);
+	m_latency[bucket(nsecs)].fetch_add(1, std::memory_order_relaxed);
+}
+void CallbackMetrics::recordQueued(const qint64 nsecs)
+{
+	m_queued[bucket(nsecs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+int CallbackMetrics::bucket(const qint64 nsecs)
+{
+	int bucket = 0;
+	while (bucket < Buckets - 1 && (qint64(2) << bucket) <= nsecs)
+	{
+		++bucket;
+	}
+	return bucket;
+}
+
+QVector<quint64> CallbackMetrics::histogram(const std::atomic<quint64> *buckets)
+{
+	// trailing empty buckets are left out, like in BatchStatistics
+	int size = Buckets;
+	while (size > 0 && buckets[size - 1].load(std::memory_order_relaxed) == 0)
+	{
+		--size;
+	}
+	QVector<quint64> result(size);
+	for (int i = 0; i < size; ++i)
+	{
+		result[i] = buckets[i].load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void CallbackMetrics::clear()
+{
+	m_sameThread.store(0, std::memory_order_relaxed);
+	m_crossThread.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < Buckets; ++i)
+	{
+		m_latency[i].store(0, std::memory_order_relaxed);
+		m_queued[i].store(0, std::memory_order_relaxed);
+	}
+}
+}
+
+#endif
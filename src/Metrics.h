@@ -0,0 +1,80 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+namespace Detail
+{
+/**
+ * @brief Calls made to one callback ID, as returned by Bindable::callbackStatistics
+ *
+ * Entry i of the histograms counts the calls that took between 2^i and 2^(i+1)-1
+ * nanoseconds.
+ */
+struct CallbackStatistics
+{
+	quint64 sameThreadCalls = 0;
+	quint64 crossThreadCalls = 0;
+	/// From the call being made until it returned (or its future was finished)
+	QVector<quint64> latencyHistogram;
+	/// For cross-thread calls, from being posted until the receiver thread started running it,
+	/// or until a waitFor() that timed out withdrew it
+	QVector<quint64> queueingHistogram;
+};
+
+#ifdef LOGICALGUI_METRICS
+/**
+ * @brief Counters for one callback ID, shared by every binding to that ID
+ *
+ * Bindings look their counters up once, when they're bound, so recording a call only costs a
+ * few relaxed atomic increments. Counters live until the program exits.
+ */
+class CallbackMetrics
+{
+	Q_DISABLE_COPY(CallbackMetrics)
+public:
+	static CallbackMetrics *forId(const QString &id);
+	static QHash<QString, CallbackStatistics> snapshot();
+	static void reset();
+
+	/// Nanoseconds on a monotonic clock
+	static qint64 now();
+
+	void recordCall(const bool crossThread, const qint64 nsecs);
+	void recordQueued(const qint64 nsecs);
+
+private:
+	CallbackMetrics();
+
+	enum
+	{
+		Buckets = 40
+	};
+	std::atomic<quint64> m_sameThread;
+	std::atomic<quint64> m_crossThread;
+	std::atomic<quint64> m_latency[Buckets];
+	std::atomic<quint64> m_queued[Buckets];
+
+	static int bucket(const qint64 nsecs);
+	static QVector<quint64> histogram(const std::atomic<quint64> *buckets);
+	void clear();
+};
+#endif
+}
@@ -0,0 +1,470 @@
+#include "Recording.h"
+
+#include <QIODevice>
+#include <QDataStream>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QSemaphore>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <chrono>
+
+#include "LogicalGui.h"
+#include "Tracer.h"
+
+namespace
+{
+enum RecordType
+{
+	/// Introduces a callback ID
+	NameRecord,
+	/// Introduces the types of a call site, by name
+	SignatureRecord,
+	CallRecord
+};
+
+const quint32 Magic = 0x4C475243; // "LGRC"
+const quint16 FormatVersion = 1;
+const QDataStream::Version StreamVersion = QDataStream::Qt_5_2;
+
+struct Log
+{
+	QMutex mutex;
+	QDataStream out;
+	QSet<int> names;
+	/// -1 for signatures whose calls can't be recorded
+	QHash<const Detail::CallSignature *, int> signatures;
+	QHash<Qt::HANDLE, quint16> threads;
+};
+
+qint64 now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QByteArray typeName(const int type)
+{
+	return type == QMetaType::Void ? QByteArray() : QByteArray(QMetaType::typeName(type));
+}
+}
+
+namespace Detail
+{
+Q_GLOBAL_STATIC(Log, s_log)
+std::atomic<bool> Recorder::s_enabled{false};
+static std::atomic<qint64> s_origin{0};
+
+bool Recorder::start(QIODevice *device)
+{
+	stop();
+	if (!device->isWritable())
+	{
+		return false;
+	}
+	QMutexLocker locker(&s_log()->mutex);
+	QDataStream &out = s_log()->out;
+	out.setDevice(device);
+	out.setVersion(StreamVersion);
+	out.resetStatus();
+	out << Magic << FormatVersion;
+	s_origin.store(now());
+	s_enabled.store(out.status() == QDataStream::Ok);
+	return s_enabled.load();
+}
+
+void Recorder::stop()
+{
+	s_enabled.store(false);
+	QMutexLocker locker(&s_log()->mutex);
+	s_log()->out.setDevice(nullptr);
+	s_log()->names.clear();
+	s_log()->signatures.clear();
+	s_log()->threads.clear();
+}
+
+void Recorder::record(const int name, const int flags, const CallSignature &signature,
+					  const void *const *args)
+{
+	const qint64 time = now() - s_origin.load(std::memory_order_relaxed);
+	// serialized before taking the lock, so big arguments don't hold up other threads
+	QByteArray arguments;
+	bool recordable = true;
+	{
+		QDataStream out(&arguments, QIODevice::WriteOnly);
+		out.setVersion(StreamVersion);
+		for (int i = 0; recordable && i < signature.count; ++i)
+		{
+			recordable = signature.types[i] != QMetaType::UnknownType &&
+						 QMetaType::save(out, signature.types[i], args[i + 1]);
+		}
+	}
+
+	Log &log = *s_log();
+	QMutexLocker locker(&log.mutex);
+	QDataStream &out = log.out;
+	if (!out.device())
+	{
+		return;
+	}
+	auto known = log.signatures.constFind(&signature);
+	if (known == log.signatures.constEnd())
+	{
+		if (!recordable)
+		{
+			qWarning("Bindable: can't record calls to %s: not all of their argument types can "
+					 "be serialized", qPrintable(Tracer::name(name)));
+		}
+		const int index = recordable ? log.signatures.size() : -1;
+		known = log.signatures.insert(&signature, index);
+		if (recordable)
+		{
+			// results are thrown away when replaying, so an unregistered one doesn't matter
+			out << quint8(SignatureRecord) << quint32(index)
+				<< typeName(signature.returnType == QMetaType::UnknownType
+								? int(QMetaType::Void)
+								: signature.returnType)
+				<< quint8(signature.count);
+			for (int i = 0; i < signature.count; ++i)
+			{
+				out << typeName(signature.types[i]);
+			}
+		}
+	}
+	if (known.value() < 0)
+	{
+		return;
+	}
+	if (!log.names.contains(name))
+	{
+		log.names.insert(name);
+		out << quint8(NameRecord) << quint32(name) << Tracer::name(name);
+	}
+	const Qt::HANDLE thread = QThread::currentThreadId();
+	if (!log.threads.contains(thread))
+	{
+		log.threads.insert(thread, quint16(log.threads.size()));
+	}
+	out << quint8(CallRecord) << quint32(name) << quint32(known.value())
+		<< log.threads.value(thread) << quint8(flags) << time;
+	out.writeRawData(arguments.constData(), arguments.size());
+}
+
+class Replay::Worker : public QThread
+{
+public:
+	Worker(Replay *replay, const QVector<Call> *calls, const QElapsedTimer *clock,
+		   const qint64 origin, const double speed)
+		: m_replay(replay), m_calls(calls), m_clock(clock), m_origin(origin), m_speed(speed)
+	{
+	}
+
+	Replay *m_replay;
+	/// Released by each request once it's done
+	QSemaphore m_done;
+	int m_posted = 0;
+
+protected:
+	void run() override
+	{
+		for (const Call &call : *m_calls)
+		{
+			if (m_speed > 0)
+			{
+				const qint64 due = qint64(double(call.m_time - m_origin) / m_speed);
+				const qint64 ahead = due - m_clock->nsecsElapsed();
+				if (ahead > 0)
+				{
+					usleep(ulong(ahead / 1000));
+				}
+				m_replay->lagged(m_clock->nsecsElapsed() - due);
+			}
+			m_replay->replay(call, this);
+		}
+		m_done.acquire(m_posted);
+	}
+
+private:
+	const QVector<Call> *m_calls;
+	const QElapsedTimer *m_clock;
+	const qint64 m_origin;
+	const double m_speed;
+};
+
+struct Replay::Posted : public DispatchCall
+{
+	Posted(const Binding &binding, const Call &call, Worker *worker)
+		: DispatchCall(binding.m_receiver, &Replay::runPosted), m_binding(binding),
+		  m_call(call), m_worker(worker)
+	{
+		prepareCall(this, binding);
+	}
+	Binding m_binding;
+	const Call &m_call;
+	Worker *m_worker;
+};
+
+Replay::Replay(Bindable *bindable) : m_bindable(bindable)
+{
+}
+
+Replay::~Replay()
+{
+}
+
+bool Replay::load(QIODevice *device)
+{
+	m_names.clear();
+	m_threads.clear();
+	m_error.clear();
+
+	QDataStream in(device);
+	in.setVersion(StreamVersion);
+	quint32 magic = 0;
+	quint16 version = 0;
+	in >> magic >> version;
+	if (magic != Magic || version != FormatVersion)
+	{
+		m_error = "not a recording, or one in a format that isn't supported";
+		return false;
+	}
+
+	struct Signature
+	{
+		int returnType;
+		QVector<int> types;
+	};
+	QHash<quint32, Signature> signatures;
+	QHash<quint32, int> names;
+	QHash<quint16, int> threads;
+	while (!in.atEnd() && in.status() == QDataStream::Ok)
+	{
+		quint8 type;
+		in >> type;
+		if (type == NameRecord)
+		{
+			quint32 name;
+			QString id;
+			in >> name >> id;
+			names.insert(name, m_names.size());
+			m_names.append(id);
+		}
+		else if (type == SignatureRecord)
+		{
+			quint32 index;
+			QByteArray returnType;
+			quint8 count;
+			in >> index >> returnType >> count;
+			if (in.status() != QDataStream::Ok)
+			{
+				break;
+			}
+			Signature &signature = signatures[index];
+			signature.returnType =
+				returnType.isEmpty() ? int(QMetaType::Void) : QMetaType::type(returnType);
+			if (signature.returnType == QMetaType::UnknownType)
+			{
+				m_error = QString("the type %1 isn't registered")
+							  .arg(QString::fromLatin1(returnType));
+				return false;
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				QByteArray name;
+				in >> name;
+				if (in.status() != QDataStream::Ok)
+				{
+					break;
+				}
+				signature.types.append(QMetaType::type(name));
+				if (signature.types.last() == QMetaType::UnknownType)
+				{
+					m_error = QString("the type %1 isn't registered")
+								  .arg(QString::fromLatin1(name));
+					return false;
+				}
+			}
+		}
+		else if (type == CallRecord)
+		{
+			quint32 name;
+			quint32 index;
+			quint16 thread;
+			quint8 flags;
+			Call call;
+			in >> name >> index >> thread >> flags >> call.m_time;
+			if (in.status() != QDataStream::Ok)
+			{
+				break;
+			}
+			if (!names.contains(name) || !signatures.contains(index))
+			{
+				m_error = "the recording is corrupt";
+				return false;
+			}
+			const Signature &signature = signatures[index];
+			call.m_name = names.value(name);
+			call.m_flags = flags;
+			call.m_returnType = signature.returnType;
+			for (const int argumentType : signature.types)
+			{
+				QVariant argument(argumentType, nullptr);
+				if (!QMetaType::load(in, argumentType, argument.data()))
+				{
+					m_error = QString("can't read the arguments of a call to %1")
+								  .arg(m_names[call.m_name]);
+					return false;
+				}
+				call.m_arguments.append(argument);
+			}
+			if (in.status() != QDataStream::Ok)
+			{
+				break;
+			}
+			if (!threads.contains(thread))
+			{
+				threads.insert(thread, m_threads.size());
+				m_threads.append(QVector<Call>());
+			}
+			m_threads[threads.value(thread)].append(call);
+		}
+		else
+		{
+			m_error = "the recording is corrupt";
+			return false;
+		}
+	}
+	// a recording that was cut short ends in a partial record, everything before it counts
+	if (in.status() == QDataStream::ReadCorruptData)
+	{
+		m_error = "the recording is corrupt";
+		return false;
+	}
+	return true;
+}
+
+int Replay::callCount() const
+{
+	int count = 0;
+	for (const QVector<Call> &calls : m_threads)
+	{
+		count += calls.size();
+	}
+	return count;
+}
+
+ReplayStatistics Replay::run(const double speed)
+{
+	m_calls.store(0);
+	m_failed.store(0);
+	m_maxLag.store(0);
+
+	qint64 origin = 0;
+	for (int i = 0; i < m_threads.size(); ++i)
+	{
+		if (!m_threads[i].isEmpty() && (i == 0 || m_threads[i].first().m_time < origin))
+		{
+			origin = m_threads[i].first().m_time;
+		}
+	}
+
+	QElapsedTimer clock;
+	QEventLoop loop;
+	QVector<Worker *> workers;
+	int running = m_threads.size();
+	for (const QVector<Call> &calls : m_threads)
+	{
+		Worker *worker = new Worker(this, &calls, &clock, origin, speed);
+		QObject::connect(worker, &QThread::finished, &loop, [&running, &loop]()
+		{
+			if (--running == 0)
+			{
+				loop.quit();
+			}
+		});
+		workers.append(worker);
+	}
+	clock.start();
+	for (Worker *worker : workers)
+	{
+		worker->start();
+	}
+	if (running > 0)
+	{
+		loop.exec();
+	}
+
+	ReplayStatistics statistics;
+	statistics.elapsed = clock.nsecsElapsed();
+	for (Worker *worker : workers)
+	{
+		worker->wait();
+		delete worker;
+	}
+	statistics.calls = m_calls.load();
+	statistics.failed = m_failed.load();
+	statistics.maxLag = m_maxLag.load();
+	return statistics;
+}
+
+void Replay::replay(const Call &call, Worker *worker)
+{
+	const BindingRef binding = m_bindable->findBinding(m_names[call.m_name]);
+	if (!binding)
+	{
+		m_calls.fetch_add(1, std::memory_order_relaxed);
+		m_failed.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	const bool all = call.m_flags & Recorder::AllBindings;
+	for (const Binding *b = &*binding; b; b = all ? b->m_next.data() : nullptr)
+	{
+		m_calls.fetch_add(1, std::memory_order_relaxed);
+		const Qt::ConnectionType type = Bindable::connectionType(*b);
+		if ((call.m_flags & Recorder::Request) && type != Qt::DirectConnection)
+		{
+			worker->m_posted++;
+			Bindable::postRequest(new Posted(*b, call, worker));
+			continue;
+		}
+		QVector<QVariant> arguments = call.m_arguments;
+		QVariant result;
+		QString error;
+		if (!Bindable::callVariants(*b, type, call.m_returnType, arguments, result, error))
+		{
+			m_failed.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+void Replay::lagged(const qint64 lag)
+{
+	qint64 worst = m_maxLag.load(std::memory_order_relaxed);
+	while (lag > worst &&
+		   !m_maxLag.compare_exchange_weak(worst, lag, std::memory_order_relaxed))
+	{
+	}
+}
+
+void Replay::runPosted(DispatchCall *call, bool receiverAlive)
+{
+	Posted *posted = static_cast<Posted *>(call);
+	Replay *replay = posted->m_worker->m_replay;
+	bool ok = false;
+	if (receiverAlive)
+	{
+		QVector<QVariant> arguments = posted->m_call.m_arguments;
+		QVariant result;
+		QString error;
+		ok = Bindable::callVariants(posted->m_binding, Qt::DirectConnection,
+									posted->m_call.m_returnType, arguments, result, error);
+	}
+	if (!ok)
+	{
+		replay->m_failed.fetch_add(1, std::memory_order_relaxed);
+	}
+	posted->m_worker->m_done.release();
+	delete posted;
+}
+}
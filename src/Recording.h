@@ -0,0 +1,148 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <QVariant>
+#include <atomic>
+
+#include "Dispatcher.h"
+#include "SlotObject.h"
+
+class QIODevice;
+class Bindable;
+
+namespace Detail
+{
+/**
+ * @brief Writes the calls made through any Bindable to a binary log, for @ref Replay
+ *
+ * Each call is logged in the calling thread when it's made, with its callback ID, its
+ * arguments (serialized with their QDataStream operators), the time and the calling thread.
+ * Callback IDs and signatures are written once, the first time they come up; calls refer to
+ * them by number. Calls answered from a binding's result cache aren't logged, they never
+ * reach a callback.
+ *
+ * While recording is off, logging costs a single relaxed load.
+ */
+class Recorder
+{
+public:
+	enum Flag
+	{
+		/// Made by request() and friends, so the caller didn't wait for it
+		Request = 1,
+		/// Made by requestAll(), so it went to every binding of its callback ID
+		AllBindings = 2
+	};
+
+	static bool start(QIODevice *device);
+	static void stop();
+	static bool isEnabled()
+	{
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+
+	/// args as for SlotObjectBase::call, without the return value
+	static void record(const int name, const int flags, const CallSignature &signature,
+					   const void *const *args);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+/// What a @ref Replay did
+struct ReplayStatistics
+{
+	int calls = 0;
+	/// Calls whose callback ID wasn't bound, whose types didn't fit, or whose receiver was gone
+	int failed = 0;
+	/// How long the replay took, in nsecs
+	qint64 elapsed = 0;
+	/// How far the replay fell behind the recording's schedule at worst, in nsecs
+	qint64 maxLag = 0;
+};
+
+/**
+ * @brief Drives the calls logged by a @ref Recorder against the bindings of a Bindable
+ *
+ * Every thread that made calls while recording gets a thread that makes the same calls, with
+ * the same arguments, at the same points in time relative to the start (or faster, see
+ * @ref run). Calls that were waited for are made as Bindable::wait would; requests are posted
+ * without waiting for them, like Bindable::request. Results are discarded.
+ *
+ * The argument types have to be registered with the same names (and have stream operators) in
+ * the replaying process, and have to match the callbacks' parameter types exactly, as for a
+ * @ref RemoteHost.
+ */
+class Replay
+{
+	Q_DISABLE_COPY(Replay)
+public:
+	/// The Bindable has to outlive the replay
+	explicit Replay(Bindable *bindable);
+	~Replay();
+
+	/// Reads a log written by a Recorder, replacing what was loaded before
+	bool load(QIODevice *device);
+	QString errorString() const
+	{
+		return m_error;
+	}
+	int callCount() const;
+	int threadCount() const
+	{
+		return m_threads.size();
+	}
+
+	/**
+	 * @brief Makes the loaded calls, and waits until all of them are done
+	 * @param speed How much faster than recorded to go; 0 makes the calls as fast as possible
+	 *
+	 * Keeps the calling thread's event loop running in the meantime, so callbacks in the
+	 * calling thread get called, too. May be called any number of times.
+	 */
+	ReplayStatistics run(const double speed = 1.0);
+
+private:
+	struct Call
+	{
+		/// nsecs since the recording started
+		qint64 m_time;
+		int m_name;
+		int m_flags;
+		int m_returnType;
+		QVector<QVariant> m_arguments;
+	};
+	class Worker;
+	/// A request, posted to the receiver's thread (or executor)
+	struct Posted;
+
+	Bindable *m_bindable;
+	QString m_error;
+	QVector<QString> m_names;
+	QVector<QVector<Call>> m_threads;
+
+	std::atomic<int> m_calls{0};
+	std::atomic<int> m_failed{0};
+	std::atomic<qint64> m_maxLag{0};
+
+	void replay(const Call &call, Worker *worker);
+	void lagged(const qint64 lag);
+	static void runPosted(DispatchCall *call, bool receiverAlive);
+};
+}
@@ -0,0 +1,594 @@
+#include "Remote.h"
+
+#include <QThread>
+#include <QLocalSocket>
+#include <QLocalServer>
+#include <QSharedMemory>
+#include <QDataStream>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+#include <QVector>
+#include <QtEndian>
+
+#include "LogicalGui.h"
+#include "Completion.h"
+
+namespace
+{
+enum FrameType
+{
+	CallFrame,
+	/// A call whose body is in a shared memory segment
+	SharedCallFrame,
+	ResultFrame
+};
+
+enum Status
+{
+	Ok,
+	NoBinding,
+	Refused
+};
+
+const QDataStream::Version StreamVersion = QDataStream::Qt_5_2;
+
+/// Frames are their payload's size, big endian, followed by the payload
+QByteArray frame(const QByteArray &payload)
+{
+	QByteArray frame(4, Qt::Uninitialized);
+	qToBigEndian<quint32>(quint32(payload.size()), reinterpret_cast<uchar *>(frame.data()));
+	return frame + payload;
+}
+bool takeFrame(QByteArray &buffer, QByteArray &payload)
+{
+	if (buffer.size() < 4)
+	{
+		return false;
+	}
+	const quint32 size =
+		qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(buffer.constData()));
+	if (quint32(buffer.size() - 4) < size)
+	{
+		return false;
+	}
+	payload = buffer.mid(4, int(size));
+	buffer.remove(0, 4 + int(size));
+	return true;
+}
+
+/// Runs func in the thread of context, and waits for it
+template <typename Func> struct TaskCall : public Detail::DispatchCall
+{
+	TaskCall(QObject *context, Func &func, Detail::Completion *done)
+		: DispatchCall(context, &run), m_func(func), m_done(done)
+	{
+	}
+	Func &m_func;
+	Detail::Completion *m_done;
+
+	static void run(Detail::DispatchCall *call, bool alive)
+	{
+		TaskCall *self = static_cast<TaskCall *>(call);
+		if (alive)
+		{
+			self->m_func();
+		}
+		self->m_done->complete();
+	}
+};
+template <typename Func> void runIn(QObject *context, Func func)
+{
+	Detail::Completion *done = Detail::Completion::forCurrentThread();
+	done->reset();
+	TaskCall<Func> call(context, func, done);
+	Detail::Dispatcher::postToReceiver(&call);
+	done->wait();
+}
+
+QByteArray readShared(const QString &key, const quint32 size)
+{
+	QSharedMemory segment(key);
+	if (!segment.attach(QSharedMemory::ReadOnly))
+	{
+		return QByteArray();
+	}
+	segment.lock();
+	const QByteArray data(static_cast<const char *>(segment.constData()),
+						  qMin(int(size), segment.size()));
+	segment.unlock();
+	return data;
+}
+}
+
+namespace Detail
+{
+struct RemoteEndpoint::Pending
+{
+	QWaitCondition m_condition;
+	bool m_done = false;
+	bool m_ok = false;
+	/// The result, or the error message
+	QVariant m_value;
+};
+
+RemoteEndpoint::Flush::Flush(RemoteEndpoint *endpoint)
+	: DispatchCall(endpoint->m_socket, &RemoteEndpoint::flushCall), m_endpoint(endpoint)
+{
+}
+
+RemoteEndpoint::RemoteEndpoint(const RemoteOptions &options)
+	: m_options(options), m_thread(new QThread), m_socket(new QLocalSocket), m_flush(this)
+{
+	QObject::connect(m_socket, &QLocalSocket::readyRead, [this]()
+	{
+		readResults();
+	});
+	QObject::connect(m_socket, &QLocalSocket::disconnected, [this]()
+	{
+		m_connected.store(false);
+		failPending("the connection was lost");
+	});
+	m_thread->start();
+	m_socket->moveToThread(m_thread);
+}
+
+RemoteEndpoint::~RemoteEndpoint()
+{
+	// also releases the shared memory of those calls
+	disconnectFromServer();
+	QLocalSocket *socket = m_socket;
+	runIn(m_socket, [socket]()
+	{
+		delete socket;
+	});
+	m_thread->quit();
+	m_thread->wait();
+	delete m_thread;
+}
+
+bool RemoteEndpoint::connectToServer(const QString &name, const int msecs)
+{
+	bool connected = false;
+	QLocalSocket *socket = m_socket;
+	runIn(m_socket, [socket, &name, msecs, &connected]()
+	{
+		socket->connectToServer(name);
+		connected = socket->waitForConnected(msecs);
+	});
+	m_connected.store(connected);
+	return connected;
+}
+
+void RemoteEndpoint::disconnectFromServer()
+{
+	QLocalSocket *socket = m_socket;
+	runIn(m_socket, [socket]()
+	{
+		socket->disconnectFromServer();
+	});
+	m_connected.store(false);
+	failPending("the endpoint was disconnected");
+}
+
+bool RemoteEndpoint::call(const QString &id, const CallSignature &signature, void **args)
+{
+	if (!m_connected.load())
+	{
+		qWarning("Bindable: remote call to %s failed: not connected", qPrintable(id));
+		return false;
+	}
+
+	QByteArray body;
+	{
+		QDataStream out(&body, QIODevice::WriteOnly);
+		out.setVersion(StreamVersion);
+		out << id;
+		out << QByteArray(signature.returnType == QMetaType::Void
+							  ? ""
+							  : QMetaType::typeName(signature.returnType));
+		out << quint8(signature.count);
+		for (int i = 0; i < signature.count; ++i)
+		{
+			out << QVariant(signature.types[i], args[i + 1]);
+		}
+	}
+
+	const quint32 callId = m_nextCall.fetch_add(1);
+	QByteArray payload;
+	QDataStream out(&payload, QIODevice::WriteOnly);
+	out.setVersion(StreamVersion);
+	// has to stay around until the other end has read it, which it has once the result is here
+	QSharedMemory *segment = nullptr;
+	if (m_options.sharedMemoryThreshold >= 0 && body.size() > m_options.sharedMemoryThreshold)
+	{
+		segment = new QSharedMemory(QString("LogicalGui-%1-%2-%3")
+										.arg(QCoreApplication::applicationPid())
+										.arg(quintptr(this))
+										.arg(callId));
+		if (segment->create(body.size()))
+		{
+			segment->lock();
+			memcpy(segment->data(), body.constData(), size_t(body.size()));
+			segment->unlock();
+			out << quint8(SharedCallFrame) << callId << segment->key() << quint32(body.size());
+		}
+		else
+		{
+			delete segment;
+			segment = nullptr;
+		}
+	}
+	if (!segment)
+	{
+		out << quint8(CallFrame) << callId << body;
+	}
+
+	Pending pending;
+	QMutexLocker locker(&m_mutex);
+	m_pending.insert(callId, &pending);
+	if (segment)
+	{
+		m_segments.insert(callId, segment);
+	}
+	locker.unlock();
+	send(frame(payload));
+	locker.relock();
+
+	QElapsedTimer timer;
+	timer.start();
+	while (!pending.m_done)
+	{
+		if (m_options.timeout < 0)
+		{
+			pending.m_condition.wait(&m_mutex);
+			continue;
+		}
+		const qint64 remaining = m_options.timeout - timer.elapsed();
+		if (remaining <= 0 || !pending.m_condition.wait(&m_mutex, ulong(remaining)))
+		{
+			break;
+		}
+	}
+	m_pending.remove(callId);
+	// unless failPending() released it already; the last one to detach removes the segment
+	delete m_segments.take(callId);
+	locker.unlock();
+
+	if (!pending.m_done)
+	{
+		qWarning("Bindable: remote call to %s failed: timed out", qPrintable(id));
+		return false;
+	}
+	if (!pending.m_ok)
+	{
+		qWarning("Bindable: remote call to %s failed: %s", qPrintable(id),
+				 qPrintable(pending.m_value.toString()));
+		return false;
+	}
+	if (args[0] && signature.returnType != QMetaType::Void)
+	{
+		QVariant &result = pending.m_value;
+		if (result.userType() != signature.returnType && !result.convert(signature.returnType))
+		{
+			qWarning("Bindable: remote call to %s failed: can't convert its result to %s",
+					 qPrintable(id), QMetaType::typeName(signature.returnType));
+			return false;
+		}
+		QMetaType::destruct(signature.returnType, args[0]);
+		QMetaType::construct(signature.returnType, args[0], result.constData());
+	}
+	return true;
+}
+
+void RemoteEndpoint::send(const QByteArray &frame)
+{
+	bool post = false;
+	{
+		QMutexLocker locker(&m_mutex);
+		m_outgoing.append(frame);
+		post = !m_flushScheduled;
+		m_flushScheduled = true;
+	}
+	if (post)
+	{
+		Dispatcher::postToReceiver(&m_flush);
+	}
+}
+
+void RemoteEndpoint::flushCall(DispatchCall *call, bool alive)
+{
+	if (alive)
+	{
+		static_cast<Flush *>(call)->m_endpoint->flush();
+	}
+}
+
+void RemoteEndpoint::flush()
+{
+	// everything queued so far goes out in one go
+	QList<QByteArray> frames;
+	{
+		QMutexLocker locker(&m_mutex);
+		frames.swap(m_outgoing);
+		m_flushScheduled = false;
+	}
+	for (const QByteArray &frame : frames)
+	{
+		m_socket->write(frame);
+	}
+	m_socket->flush();
+}
+
+void RemoteEndpoint::readResults()
+{
+	m_buffer += m_socket->readAll();
+	QByteArray payload;
+	while (takeFrame(m_buffer, payload))
+	{
+		QDataStream in(payload);
+		in.setVersion(StreamVersion);
+		quint8 type;
+		quint32 callId;
+		quint8 status;
+		QVariant value;
+		in >> type >> callId >> status >> value;
+		if (type != ResultFrame)
+		{
+			continue;
+		}
+
+		QMutexLocker locker(&m_mutex);
+		// whoever made the call might have given up already
+		if (Pending *pending = m_pending.value(callId))
+		{
+			pending->m_done = true;
+			pending->m_ok = status == Ok && in.status() == QDataStream::Ok;
+			pending->m_value = in.status() == QDataStream::Ok
+								   ? value
+								   : QVariant(QString("can't read its result"));
+			pending->m_condition.wakeOne();
+		}
+	}
+}
+
+void RemoteEndpoint::failPending(const QString &error)
+{
+	QMutexLocker locker(&m_mutex);
+	for (Pending *pending : m_pending)
+	{
+		if (!pending->m_done)
+		{
+			pending->m_done = true;
+			pending->m_value = error;
+			pending->m_condition.wakeOne();
+		}
+	}
+	// nobody is going to read them anymore
+	qDeleteAll(m_segments);
+	m_segments.clear();
+}
+
+RemoteSlotObject::RemoteSlotObject(RemoteEndpoint *endpoint, const QString &id)
+	: m_endpoint(endpoint), m_id(id)
+{
+}
+
+void RemoteSlotObject::call(QObject *, void **, const uint)
+{
+	Q_UNREACHABLE();
+}
+
+void RemoteSlotObject::marshal(void **args, const CallSignature &signature)
+{
+	m_endpoint->call(m_id, signature, args);
+}
+
+const CallPlan *RemoteSlotObject::plan(const CallSignature *signature)
+{
+	if (const CallPlan *plan = m_plans.find(signature))
+	{
+		return plan;
+	}
+	return m_plans.add(signature, makePlan(*signature));
+}
+
+CallPlan RemoteSlotObject::makePlan(const CallSignature &signature) const
+{
+	CallPlan plan = {false, QMetaType::UnknownType, QMetaType::UnknownType, &signature};
+	if (signature.returnType == QMetaType::UnknownType)
+	{
+		qWarning("Bindable: can't call %s remotely: the requested return type is not "
+				 "registered", qPrintable(m_id));
+		return plan;
+	}
+	for (int i = 0; i < signature.count; ++i)
+	{
+		if (signature.types[i] == QMetaType::UnknownType)
+		{
+			qWarning("Bindable: can't call %s remotely: argument %d has an unregistered type",
+					 qPrintable(m_id), i + 1);
+			return plan;
+		}
+	}
+	plan.valid = true;
+	return plan;
+}
+
+RemoteHost::RemoteHost(Bindable *bindable)
+	: m_bindable(bindable), m_thread(new QThread), m_server(new QLocalServer)
+{
+	QObject::connect(m_server, &QLocalServer::newConnection, [this]()
+	{
+		accept();
+	});
+	m_thread->start();
+	m_server->moveToThread(m_thread);
+}
+
+RemoteHost::Connection::Connection(QLocalSocket *socket)
+	: m_thread(new QThread), m_socket(socket)
+{
+	// it's the server's child, but it's going to live in a thread of its own
+	m_socket->setParent(nullptr);
+	// deleted in that thread, as it stops
+	QObject::connect(m_thread, &QThread::finished, m_socket, &QObject::deleteLater);
+}
+
+RemoteHost::Connection::~Connection()
+{
+	m_thread->quit();
+	m_thread->wait();
+	delete m_thread;
+}
+
+RemoteHost::~RemoteHost()
+{
+	QLocalServer *server = m_server;
+	QList<Connection *> *connections = &m_connections;
+	runIn(m_server, [server, connections]()
+	{
+		qDeleteAll(*connections);
+		connections->clear();
+		delete server;
+	});
+	m_thread->quit();
+	m_thread->wait();
+	delete m_thread;
+}
+
+bool RemoteHost::listen(const QString &name)
+{
+	bool listening = false;
+	QLocalServer *server = m_server;
+	QString *error = &m_error;
+	runIn(m_server, [server, &name, &listening, error]()
+	{
+		QLocalServer::removeServer(name);
+		listening = server->listen(name);
+		*error = listening ? QString() : server->errorString();
+	});
+	return listening;
+}
+
+void RemoteHost::close()
+{
+	QLocalServer *server = m_server;
+	runIn(m_server, [server]()
+	{
+		server->close();
+	});
+}
+
+void RemoteHost::accept()
+{
+	for (auto it = m_connections.begin(); it != m_connections.end();)
+	{
+		if ((*it)->m_closed.load())
+		{
+			delete *it;
+			it = m_connections.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	while (QLocalSocket *socket = m_server->nextPendingConnection())
+	{
+		Connection *connection = new Connection(socket);
+		m_connections.append(connection);
+		// both are emitted, and handled, in the connection's thread
+		QObject::connect(socket, &QLocalSocket::readyRead, [this, connection]()
+		{
+			readCalls(connection);
+		});
+		QObject::connect(socket, &QLocalSocket::disconnected, [connection]()
+		{
+			connection->m_closed.store(true);
+			connection->m_thread->quit();
+		});
+		connection->m_thread->start();
+		socket->moveToThread(connection->m_thread);
+	}
+}
+
+void RemoteHost::readCalls(Connection *connection)
+{
+	QLocalSocket *socket = connection->m_socket;
+	connection->m_buffer += socket->readAll();
+	QByteArray payload;
+	while (takeFrame(connection->m_buffer, payload))
+	{
+		socket->write(frame(handle(payload)));
+	}
+	socket->flush();
+}
+
+QByteArray RemoteHost::handle(const QByteArray &payload)
+{
+	QDataStream in(payload);
+	in.setVersion(StreamVersion);
+	quint8 type;
+	quint32 callId;
+	in >> type >> callId;
+	QByteArray body;
+	if (type == SharedCallFrame)
+	{
+		QString key;
+		quint32 size;
+		in >> key >> size;
+		body = readShared(key, size);
+	}
+	else
+	{
+		in >> body;
+	}
+
+	QVariant result;
+	const int status = invoke(body, result);
+	QByteArray reply;
+	QDataStream out(&reply, QIODevice::WriteOnly);
+	out.setVersion(StreamVersion);
+	out << quint8(ResultFrame) << callId << quint8(status) << result;
+	return reply;
+}
+
+int RemoteHost::invoke(const QByteArray &body, QVariant &result)
+{
+	QDataStream in(body);
+	in.setVersion(StreamVersion);
+	QString id;
+	QByteArray returnTypeName;
+	quint8 count = 0;
+	in >> id >> returnTypeName >> count;
+	QVector<QVariant> arguments(count);
+	for (int i = 0; i < count; ++i)
+	{
+		in >> arguments[i];
+	}
+	if (body.isEmpty() || in.status() != QDataStream::Ok)
+	{
+		result = QString("can't read the call");
+		return Refused;
+	}
+
+	const BindingRef binding = m_bindable->findBinding(id);
+	if (!binding)
+	{
+		result = QString("no binding found for the given callback ID");
+		return NoBinding;
+	}
+	const int returnType =
+		returnTypeName.isEmpty() ? int(QMetaType::Void) : QMetaType::type(returnTypeName);
+	QString error;
+	if (!Bindable::callVariants(*binding, Bindable::connectionType(*binding), returnType,
+								arguments, result, error))
+	{
+		result = error;
+		return Refused;
+	}
+	return Ok;
+}
+}
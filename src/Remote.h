@@ -0,0 +1,196 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <atomic>
+
+#include "Dispatcher.h"
+#include "SlotObject.h"
+
+class QThread;
+class QLocalSocket;
+class QLocalServer;
+class QSharedMemory;
+class Bindable;
+
+namespace Detail
+{
+/// How a @ref RemoteEndpoint talks to the other process
+struct RemoteOptions
+{
+	/**
+	 * @brief Hand arguments that take more than this many bytes over through shared memory
+	 *
+	 * Only the name of the segment goes through the socket then. -1 (the default) always uses
+	 * the socket. Results always come back through the socket.
+	 */
+	int sharedMemoryThreshold = -1;
+	/// How long a call waits for its result in msecs, or -1 to wait as long as it takes
+	int timeout = -1;
+};
+
+/**
+ * @brief The calling end of a connection to a @ref RemoteHost, usually in another process
+ *
+ * Callback IDs are bound to it with Bindable::bindRemote. Arguments and results go over a
+ * local socket (a Unix domain socket or named pipe), serialized with QDataStream through their
+ * QVariant stream operators. So their types have to be known to the meta type system, and
+ * custom types need qRegisterMetaTypeStreamOperators, on both ends.
+ *
+ * The socket lives in a thread of its own. Calls from any number of threads are written to it
+ * as they're made, without waiting for earlier ones to return, and each caller only waits for
+ * its own result. To have Bindable::request return right away, also bind the callback ID to an
+ * @ref Executor that has threads to wait in, like a PoolExecutor.
+ *
+ * A call that fails (because there's no connection, it times out, or the other end refuses it)
+ * returns a default constructed value, after a warning.
+ */
+class RemoteEndpoint
+{
+	Q_DISABLE_COPY(RemoteEndpoint)
+public:
+	explicit RemoteEndpoint(const RemoteOptions &options = RemoteOptions());
+	/// Fails the calls that are still waiting for their results, releasing their shared memory
+	~RemoteEndpoint();
+
+	/// Connects to the RemoteHost listening under name, waiting for up to msecs
+	bool connectToServer(const QString &name, const int msecs = 30000);
+	void disconnectFromServer();
+	bool isConnected() const
+	{
+		return m_connected.load();
+	}
+
+	/**
+	 * @brief Calls id on the other end, and waits for the result
+	 * @param args As for SlotObjectBase::call; if args[0] isn't null the result is stored there
+	 * @returns False if the call failed
+	 */
+	bool call(const QString &id, const CallSignature &signature, void **args);
+
+private:
+	struct Pending;
+	/// Writes what has been queued; there's only ever one of it in flight
+	struct Flush : public DispatchCall
+	{
+		explicit Flush(RemoteEndpoint *endpoint);
+		RemoteEndpoint *m_endpoint;
+	};
+
+	RemoteOptions m_options;
+	QThread *m_thread;
+	QLocalSocket *m_socket;
+	Flush m_flush;
+	std::atomic<bool> m_connected{false};
+	std::atomic<quint32> m_nextCall{0};
+
+	QMutex m_mutex;
+	QHash<quint32, Pending *> m_pending;
+	/// Arguments handed over in shared memory, until their call is done or has failed
+	QHash<quint32, QSharedMemory *> m_segments;
+	QList<QByteArray> m_outgoing;
+	bool m_flushScheduled = false;
+	/// What has been read of the next result, only used in the socket's thread
+	QByteArray m_buffer;
+
+	void send(const QByteArray &frame);
+	void flush();
+	void readResults();
+	void failPending(const QString &error);
+	static void flushCall(DispatchCall *call, bool alive);
+};
+
+/// Turns calls made through it into calls on a @ref RemoteEndpoint
+class RemoteSlotObject : public SlotObjectBase
+{
+public:
+	RemoteSlotObject(RemoteEndpoint *endpoint, const QString &id);
+
+	/// Never used, the plans ask for @ref marshal
+	void call(QObject *receiver, void **args, const uint movable) override;
+	void marshal(void **args, const CallSignature &signature) override;
+	/// Calls are valid if all their types can be serialized
+	const CallPlan *plan(const CallSignature *signature) override;
+
+private:
+	RemoteEndpoint *m_endpoint;
+	QString m_id;
+	PlanList m_plans;
+
+	CallPlan makePlan(const CallSignature &signature) const;
+};
+
+/**
+ * @brief Serves the bindings of a Bindable to @ref RemoteEndpoint "RemoteEndpoints"
+ *
+ * Listens on a local socket in a thread of its own, and serves each connection in another
+ * thread of its own, calling the bindings as Bindable::wait would from there. So callbacks in
+ * other threads, like the GUI thread, are called blocking, and the calls from one endpoint are
+ * made one after the other, but a slow callback doesn't hold up the other endpoints. The
+ * argument types have to match the callback's parameter types exactly.
+ *
+ * The Bindable has to outlive the host.
+ */
+class RemoteHost
+{
+	Q_DISABLE_COPY(RemoteHost)
+public:
+	explicit RemoteHost(Bindable *bindable);
+	~RemoteHost();
+
+	/// Starts listening under name, replacing a socket left behind by a host that crashed
+	bool listen(const QString &name);
+	void close();
+	QString errorString() const
+	{
+		return m_error;
+	}
+
+private:
+	/// A connected endpoint, served in a thread of its own
+	struct Connection
+	{
+		explicit Connection(QLocalSocket *socket);
+		/// Waits for a call that's still being made; the socket goes with the thread
+		~Connection();
+		QThread *m_thread;
+		QLocalSocket *m_socket;
+		/// What has been read of the next call, only used in the connection's thread
+		QByteArray m_buffer;
+		/// Set once the endpoint has disconnected, which stops the thread
+		std::atomic<bool> m_closed{false};
+	};
+
+	Bindable *m_bindable;
+	QThread *m_thread;
+	QLocalServer *m_server;
+	QString m_error;
+	/// Only used in the host's thread; closed ones are cleaned up as the next one connects
+	QList<Connection *> m_connections;
+
+	void accept();
+	void readCalls(Connection *connection);
+	QByteArray handle(const QByteArray &payload);
+	/// Returns the status, the result is the callback's or an error message
+	int invoke(const QByteArray &body, QVariant &result);
+};
+}
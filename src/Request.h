@@ -0,0 +1,373 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QSharedPointer>
+#include <QVector>
+#include <type_traits>
+#include <utility>
+
+#include "Dispatcher.h"
+
+namespace Detail
+{
+template <typename T> class Request;
+
+template <typename T> struct UnwrapRequest
+{
+	typedef T type;
+};
+template <typename T> struct UnwrapRequest<Request<T>>
+{
+	typedef T type;
+};
+
+/// Calls a continuation with the result of a finished future, or without one for void
+template <typename T> struct ApplyResult
+{
+	template <typename Func>
+	static auto call(Func &func, const QFuture<T> &future) -> decltype(func(future.result()))
+	{
+		return func(future.result());
+	}
+};
+template <> struct ApplyResult<void>
+{
+	template <typename Func>
+	static auto call(Func &func, const QFuture<void> &) -> decltype(func())
+	{
+		return func();
+	}
+};
+
+/// The result of a finished future, or a default constructed value if it was canceled
+template <typename T> T resultOrDefault(const QFuture<T> &future)
+{
+	return future.isCanceled() ? T() : future.result();
+}
+inline void resultOrDefault(const QFuture<void> &)
+{
+}
+
+template <typename T>
+void finishRequest(QFutureInterface<T> &iface, Continuations &continuations, const bool canceled)
+{
+	if (canceled)
+	{
+		iface.reportCanceled();
+	}
+	iface.reportFinished();
+	continuations.close();
+}
+
+/**
+ * @brief Completes a request with the result of another one, once that has finished
+ *
+ * Without a context it's run by whatever thread finishes the other request.
+ */
+template <typename T> class ForwardCall : public DispatchCall
+{
+public:
+	ForwardCall(const QObject *context, const QFuture<T> &source, const QFutureInterface<T> &iface,
+				const QSharedPointer<Continuations> &continuations)
+		: DispatchCall(context, &dispatch), m_source(source), m_iface(iface),
+		  m_continuations(continuations)
+	{
+	}
+
+private:
+	QFuture<T> m_source;
+	QFutureInterface<T> m_iface;
+	QSharedPointer<Continuations> m_continuations;
+
+	template <typename U> static void forward(QFutureInterface<U> &iface, const QFuture<U> &from)
+	{
+		iface.reportResult(from.result());
+	}
+	static void forward(QFutureInterface<void> &, const QFuture<void> &)
+	{
+	}
+
+	static void dispatch(DispatchCall *call, bool receiverAlive)
+	{
+		ForwardCall *self = static_cast<ForwardCall *>(call);
+		const bool canceled =
+			(self->m_hasReceiver && !receiverAlive) || self->m_source.isCanceled();
+		if (!canceled)
+		{
+			forward(self->m_iface, self->m_source);
+		}
+		finishRequest(self->m_iface, *self->m_continuations, canceled);
+		delete self;
+	}
+};
+
+/// Reports what a continuation returned as the result of the request it makes up
+template <typename Result> struct DeliverResult
+{
+	template <typename Func, typename T>
+	static void run(Func &func, const QFuture<T> &source, QFutureInterface<Result> &iface,
+					const QSharedPointer<Continuations> &continuations, const QObject *)
+	{
+		iface.reportResult(ApplyResult<T>::call(func, source));
+		finishRequest(iface, *continuations, false);
+	}
+};
+template <> struct DeliverResult<void>
+{
+	template <typename Func, typename T>
+	static void run(Func &func, const QFuture<T> &source, QFutureInterface<void> &iface,
+					const QSharedPointer<Continuations> &continuations, const QObject *)
+	{
+		ApplyResult<T>::call(func, source);
+		finishRequest(iface, *continuations, false);
+	}
+};
+/// A continuation that makes another request finishes along with that one
+template <typename Value> struct DeliverResult<Request<Value>>
+{
+	template <typename Func, typename T>
+	static void run(Func &func, const QFuture<T> &source, QFutureInterface<Value> &iface,
+					const QSharedPointer<Continuations> &continuations, const QObject *context)
+	{
+		const Request<Value> inner = ApplyResult<T>::call(func, source);
+		inner.m_continuations->add(new ForwardCall<Value>(context, inner, iface, continuations));
+	}
+};
+
+/// Runs a continuation on its context's thread once the request it follows has finished
+template <typename T, typename Func> class ThenCall : public DispatchCall
+{
+public:
+	typedef decltype(ApplyResult<T>::call(std::declval<Func &>(),
+										  std::declval<const QFuture<T> &>())) Result;
+	typedef typename UnwrapRequest<Result>::type Value;
+
+	ThenCall(const QObject *context, const QFuture<T> &source, Func func)
+		: DispatchCall(context, &dispatch), m_source(source), m_func(std::move(func)),
+		  m_continuations(new Continuations)
+	{
+		m_iface.reportStarted();
+	}
+
+	Request<Value> request()
+	{
+		return Request<Value>(m_iface.future(), m_continuations);
+	}
+
+private:
+	QFuture<T> m_source;
+	Func m_func;
+	QFutureInterface<Value> m_iface;
+	QSharedPointer<Continuations> m_continuations;
+
+	static void dispatch(DispatchCall *call, bool receiverAlive)
+	{
+		ThenCall *self = static_cast<ThenCall *>(call);
+		// one without a context is run as soon as the source is done, wherever that is
+		const bool alive = receiverAlive || !self->m_hasReceiver;
+		if (alive && !self->m_source.isCanceled())
+		{
+			DeliverResult<Result>::run(self->m_func, self->m_source, self->m_iface,
+									   self->m_continuations, self->m_receiver.data());
+		}
+		else
+		{
+			finishRequest(self->m_iface, *self->m_continuations, true);
+		}
+		delete self;
+	}
+};
+
+/**
+ * @brief The result of Bindable::request
+ *
+ * A QFuture that can also be continued with @ref then, without anybody having to wait for it.
+ */
+template <typename T> class Request : public QFuture<T>
+{
+public:
+	Request(const QFuture<T> &future, const QSharedPointer<Continuations> &continuations)
+		: QFuture<T>(future), m_continuations(continuations)
+	{
+	}
+
+	/**
+	 * @brief Calls func with the result once it's there, on the thread of context
+	 * @returns A request for what func returns. If func itself returns a Request, the returned
+	 * one finishes along with it, so requests and transformations can be chained.
+	 *
+	 * If context is null, func runs on whatever thread finishes this request (usually the
+	 *receiver's), right after it has finished. If this request is canceled, or context is
+	 *deleted before func could run, the returned request is canceled (and so are the ones
+	 *chained to it). func takes no argument if this is a Request<void>.
+	 */
+	template <typename Func>
+	Request<typename ThenCall<T, Func>::Value> then(const QObject *context, Func func) const
+	{
+		auto call = new ThenCall<T, Func>(context, *this, std::move(func));
+		const Request<typename ThenCall<T, Func>::Value> next = call->request();
+		m_continuations->add(call);
+		return next;
+	}
+
+	QSharedPointer<Continuations> m_continuations;
+};
+
+/**
+ * @brief Collects the results of calls to all bindings of one callback ID into one request
+ *
+ * Each call stores its result in its own slot, so they may finish in any order and on any
+ * thread; whichever finishes last completes the request. If any call is canceled, so is the
+ * whole request.
+ */
+template <typename Ret> class Gather
+{
+	Q_DISABLE_COPY(Gather)
+public:
+	typedef QVector<Ret> Result;
+
+	explicit Gather(const int count)
+		: m_results(count), m_slots(m_results.data()), m_remaining(count), m_canceled(false),
+		  m_continuations(new Continuations)
+	{
+		m_iface.reportStarted();
+	}
+
+	Request<Result> request()
+	{
+		return Request<Result>(m_iface.future(), m_continuations);
+	}
+
+	void set(const int index, Ret value)
+	{
+		m_slots[index] = std::move(value);
+		done();
+	}
+	void set(const int index, const QFuture<Ret> &future)
+	{
+		set(index, future.result());
+	}
+	void cancel()
+	{
+		m_canceled.store(true);
+		done();
+	}
+
+private:
+	QVector<Ret> m_results;
+	// written through directly, so concurrent writers never make the vector detach
+	Ret *m_slots;
+	std::atomic<int> m_remaining;
+	std::atomic<bool> m_canceled;
+	QFutureInterface<Result> m_iface;
+	QSharedPointer<Continuations> m_continuations;
+
+	void done()
+	{
+		if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			if (!m_canceled.load())
+			{
+				m_iface.reportResult(m_results);
+			}
+			finishRequest(m_iface, *m_continuations, m_canceled.load());
+		}
+	}
+};
+template <> class Gather<void>
+{
+	Q_DISABLE_COPY(Gather)
+public:
+	typedef void Result;
+
+	explicit Gather(const int count)
+		: m_remaining(count), m_canceled(false), m_continuations(new Continuations)
+	{
+		m_iface.reportStarted();
+	}
+
+	Request<void> request()
+	{
+		return Request<void>(m_iface.future(), m_continuations);
+	}
+
+	void set(const int)
+	{
+		done();
+	}
+	void set(const int, const QFuture<void> &)
+	{
+		done();
+	}
+	void cancel()
+	{
+		m_canceled.store(true);
+		done();
+	}
+
+private:
+	std::atomic<int> m_remaining;
+	std::atomic<bool> m_canceled;
+	QFutureInterface<void> m_iface;
+	QSharedPointer<Continuations> m_continuations;
+
+	void done()
+	{
+		if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			finishRequest(m_iface, *m_continuations, m_canceled.load());
+		}
+	}
+};
+
+/**
+ * @brief Hands the result of one of the calls to a @ref Gather, once that call is done
+ *
+ * It has no receiver, so it runs right where the call finishes (or is dropped, which cancels
+ * the call's future).
+ */
+template <typename Ret> class GatherCall : public DispatchCall
+{
+public:
+	GatherCall(const QFuture<Ret> &source, const QSharedPointer<Gather<Ret>> &gather,
+			   const int index)
+		: DispatchCall(nullptr, &dispatch), m_source(source), m_gather(gather), m_index(index)
+	{
+	}
+
+private:
+	QFuture<Ret> m_source;
+	QSharedPointer<Gather<Ret>> m_gather;
+	int m_index;
+
+	static void dispatch(DispatchCall *call, bool)
+	{
+		GatherCall *self = static_cast<GatherCall *>(call);
+		if (!self->m_source.isCanceled())
+		{
+			self->m_gather->set(self->m_index, self->m_source);
+		}
+		else
+		{
+			self->m_gather->cancel();
+		}
+		delete self;
+	}
+};
+}
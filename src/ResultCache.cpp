@@ -0,0 +1,113 @@
+#include "ResultCache.h"
+
+#include <chrono>
+
+namespace Detail
+{
+// msecs on a monotonic clock
+static qint64 now()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ResultCache::ResultCache(const int maxEntries, const int ttl)
+	: m_maxEntries(qMax(1, maxEntries)), m_ttl(ttl)
+{
+}
+
+ResultCache::~ResultCache()
+{
+	clear();
+}
+
+void ResultCache::clear()
+{
+	QMutexLocker locker(&m_mutex);
+	qDeleteAll(m_entries);
+	m_entries.clear();
+	m_newest = m_oldest = nullptr;
+}
+
+bool ResultCache::lookup(const CallSignature *signature, const uint hash, const void *key,
+						 void *result)
+{
+	QMutexLocker locker(&m_mutex);
+	Entry *entry = findEntry(signature, hash, key);
+	if (!entry)
+	{
+		return false;
+	}
+	unlink(entry);
+	link(entry);
+	entry->copyResult(result);
+	return true;
+}
+
+void ResultCache::store(Entry *entry, const void *key)
+{
+	entry->m_expires = m_ttl >= 0 ? now() + m_ttl : -1;
+	QMutexLocker locker(&m_mutex);
+	// somebody else might have stored it while we were calling
+	if (Entry *existing = findEntry(entry->m_signature, entry->m_hash, key))
+	{
+		remove(existing);
+	}
+	m_entries.insert(entry->m_hash, entry);
+	link(entry);
+	while (m_entries.size() > m_maxEntries)
+	{
+		remove(m_oldest);
+	}
+}
+
+ResultCache::Entry *ResultCache::findEntry(const CallSignature *signature, const uint hash,
+										   const void *key)
+{
+	auto it = m_entries.find(hash);
+	while (it != m_entries.end() && it.key() == hash)
+	{
+		Entry *entry = it.value();
+		++it;
+		if (entry->m_signature != signature || !entry->matches(key))
+		{
+			continue;
+		}
+		if (entry->m_expires >= 0 && entry->m_expires <= now())
+		{
+			remove(entry);
+			return nullptr;
+		}
+		return entry;
+	}
+	return nullptr;
+}
+
+void ResultCache::remove(Entry *entry)
+{
+	m_entries.remove(entry->m_hash, entry);
+	unlink(entry);
+	delete entry;
+}
+
+void ResultCache::link(Entry *entry)
+{
+	entry->m_older = m_newest;
+	entry->m_newer = nullptr;
+	if (m_newest)
+	{
+		m_newest->m_newer = entry;
+	}
+	m_newest = entry;
+	if (!m_oldest)
+	{
+		m_oldest = entry;
+	}
+}
+
+void ResultCache::unlink(Entry *entry)
+{
+	(entry->m_newer ? entry->m_newer->m_older : m_newest) = entry->m_older;
+	(entry->m_older ? entry->m_older->m_newer : m_oldest) = entry->m_newer;
+}
+}
@@ -0,0 +1,200 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "SlotObject.h"
+
+namespace Detail
+{
+/// Whether values of T can be part of a key for calls: copyable, hashable and comparable
+template <typename T> struct IsCacheKey
+{
+	template <typename U>
+	static auto test(int) -> decltype(qHash(std::declval<const U &>()),
+									  std::declval<const U &>() == std::declval<const U &>(),
+									  std::true_type());
+	template <typename U> static std::false_type test(...);
+
+	static const bool value =
+		std::is_copy_constructible<T>::value && decltype(test<T>(0))::value;
+};
+
+/**
+ * @brief What an argument of type T is kept as in a key: a copy of its decayed type
+ *
+ * Except that C strings (string literals decay to them) are keyed on their contents rather
+ * than their address.
+ */
+template <typename T> struct CacheKeyOf
+{
+	typedef T type;
+};
+template <> struct CacheKeyOf<char *>
+{
+	typedef QByteArray type;
+};
+template <> struct CacheKeyOf<const char *>
+{
+	typedef QByteArray type;
+};
+template <typename T> struct CacheKey
+{
+	typedef typename CacheKeyOf<typename std::decay<T>::type>::type type;
+};
+/// Turns an argument into what it's looked up as, see @ref CacheKey
+template <typename T> const T &keyArgument(const T &value)
+{
+	return value;
+}
+inline QByteArray keyArgument(const char *value)
+{
+	return QByteArray(value);
+}
+inline QByteArray keyArgument(char *value)
+{
+	return QByteArray(value);
+}
+
+template <typename... Params> struct AreCacheKeys;
+template <> struct AreCacheKeys<> : std::true_type
+{
+};
+template <typename P, typename... Rest>
+struct AreCacheKeys<P, Rest...>
+	: std::integral_constant<bool, IsCacheKey<typename CacheKey<P>::type>::value &&
+									   AreCacheKeys<Rest...>::value>
+{
+};
+/// Whether calls with these types can be answered from a @ref ResultCache at all
+template <typename Ret, typename... Params>
+struct IsCacheable
+	: std::integral_constant<bool, std::is_default_constructible<Ret>::value &&
+									   std::is_copy_assignable<Ret>::value &&
+									   AreCacheKeys<Params...>::value>
+{
+};
+
+template <typename Tuple, std::size_t... I> uint hashArguments(const Tuple &key, Sequence<I...>)
+{
+	uint hash = 0;
+	const int combine[] = {0, (hash = hash * 31 + qHash(std::get<I>(key)), 0)...};
+	Q_UNUSED(combine)
+	return hash;
+}
+/// Combines the hashes of each element of a tuple of arguments
+template <typename... Args> uint hashArguments(const std::tuple<Args...> &key)
+{
+	return hashArguments(key, typename SequenceGenerator<sizeof...(Args)>::type());
+}
+
+/**
+ * @brief Results of a binding, keyed on the argument values they were called with
+ *
+ * Holds at most a fixed number of results, evicting the least recently used one when it's
+ * full, and optionally lets results expire after a while. Results for different call
+ * signatures are kept apart, so a call with an int and one with a qint64 never share a result.
+ * May be used from any thread.
+ */
+class ResultCache
+{
+	Q_DISABLE_COPY(ResultCache)
+public:
+	/// @param ttl How long results stay valid in msecs, or -1 for as long as they're cached
+	ResultCache(const int maxEntries, const int ttl);
+	~ResultCache();
+
+	/// If there's a result for args, copies it to result
+	template <typename Ret, typename... Args> bool find(Ret &result, const Args &... args)
+	{
+		return findKey<Ret, typename CacheKey<Args>::type...>(result, keyArgument(args)...);
+	}
+	/// key holds the @ref CacheKey of each argument
+	template <typename Ret, typename... Args>
+	void insert(const Ret &result, std::tuple<Args...> &&key)
+	{
+		auto entry = new TypedEntry<Ret, Args...>(result, std::move(key));
+		entry->m_signature = CallSignatureFor<Ret, Args...>::get();
+		entry->m_hash = hashArguments(entry->m_key);
+		const std::tuple<const Args &...> keyRef(entry->m_key);
+		store(entry, &keyRef);
+	}
+	void clear();
+
+private:
+	struct Entry
+	{
+		virtual ~Entry()
+		{
+		}
+		/// key points to a std::tuple of references to the arguments
+		virtual bool matches(const void *key) const = 0;
+		virtual void copyResult(void *result) const = 0;
+
+		const CallSignature *m_signature;
+		uint m_hash;
+		qint64 m_expires;
+		Entry *m_newer;
+		Entry *m_older;
+	};
+	template <typename Ret, typename... Args> struct TypedEntry : public Entry
+	{
+		TypedEntry(const Ret &result, std::tuple<Args...> &&key)
+			: m_result(result), m_key(std::move(key))
+		{
+		}
+		bool matches(const void *key) const override
+		{
+			return m_key == *static_cast<const std::tuple<const Args &...> *>(key);
+		}
+		void copyResult(void *result) const override
+		{
+			*static_cast<Ret *>(result) = m_result;
+		}
+
+		Ret m_result;
+		std::tuple<Args...> m_key;
+	};
+
+	template <typename Ret, typename... Keys> bool findKey(Ret &result, const Keys &... keys)
+	{
+		const std::tuple<const Keys &...> key(keys...);
+		return lookup(CallSignatureFor<Ret, Keys...>::get(), hashArguments(key), &key, &result);
+	}
+
+	int m_maxEntries;
+	int m_ttl;
+	QMutex m_mutex;
+	QMultiHash<uint, Entry *> m_entries;
+	// least recently used list
+	Entry *m_newest = nullptr;
+	Entry *m_oldest = nullptr;
+
+	bool lookup(const CallSignature *signature, const uint hash, const void *key, void *result);
+	void store(Entry *entry, const void *key);
+	/// The matching entry, or null; expired entries are removed on the way
+	Entry *findEntry(const CallSignature *signature, const uint hash, const void *key);
+	void remove(Entry *entry);
+	void link(Entry *entry);
+	void unlink(Entry *entry);
+};
+}
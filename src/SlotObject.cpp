@@ -0,0 +1,168 @@
+#include "SlotObject.h"
+
+#include <QMutex>
+#include <QHash>
+#include <algorithm>
+
+namespace Detail
+{
+const CallPlan *CallPlan::direct()
+{
+	static const CallPlan plan = {true, QMetaType::UnknownType, QMetaType::UnknownType,
+								  nullptr};
+	return &plan;
+}
+
+const CallSignature *internSignature(const int returnType, const QVector<int> &types)
+{
+	static QMutex mutex;
+	static QHash<QByteArray, const CallSignature *> signatures;
+	QByteArray key(reinterpret_cast<const char *>(&returnType), sizeof(int));
+	key.append(reinterpret_cast<const char *>(types.constData()),
+			   int(types.size() * sizeof(int)));
+	QMutexLocker locker(&mutex);
+	const CallSignature *&signature = signatures[key];
+	if (!signature)
+	{
+		int *copy = new int[types.size()];
+		std::copy(types.begin(), types.end(), copy);
+		signature = new CallSignature{returnType, types.size(), copy};
+	}
+	return signature;
+}
+
+PlanList::~PlanList()
+{
+	Entry *entry = m_head.load();
+	while (entry)
+	{
+		Entry *next = entry->m_next;
+		delete entry;
+		entry = next;
+	}
+}
+
+const CallPlan *PlanList::find(const CallSignature *signature) const
+{
+	for (Entry *entry = m_head.load(std::memory_order_acquire); entry; entry = entry->m_next)
+	{
+		if (entry->m_signature == signature)
+		{
+			return &entry->m_plan;
+		}
+	}
+	return nullptr;
+}
+
+const CallPlan *PlanList::add(const CallSignature *signature, const CallPlan &plan)
+{
+	Entry *entry = new Entry{signature, plan, nullptr};
+	Entry *head = m_head.load(std::memory_order_relaxed);
+	do
+	{
+		entry->m_next = head;
+	} while (!m_head.compare_exchange_weak(head, entry, std::memory_order_release,
+										   std::memory_order_relaxed));
+	return &entry->m_plan;
+}
+
+MetaMethodSlotObject::MetaMethodSlotObject(const QMetaMethod &method)
+	: m_index(method.methodIndex()), m_signature(method.methodSignature()),
+	  m_returnType(method.returnType())
+{
+	const QMetaObject *mo = method.enclosingMetaObject();
+	m_staticMetacall = mo->d.static_metacall;
+	m_localIndex = m_index - mo->methodOffset();
+
+	m_parameterTypes.reserve(method.parameterCount());
+	for (int i = 0; i < method.parameterCount(); ++i)
+	{
+		m_parameterTypes.append(method.parameterType(i));
+	}
+}
+
+MetaMethodSlotObject::~MetaMethodSlotObject()
+{
+}
+
+void MetaMethodSlotObject::call(QObject *receiver, void **args, const uint)
+{
+	if (m_staticMetacall)
+	{
+		m_staticMetacall(receiver, QMetaObject::InvokeMetaMethod, m_localIndex, args);
+	}
+	else
+	{
+		// meta-objects that aren't generated by moc may only implement the virtual one
+		receiver->qt_metacall(QMetaObject::InvokeMetaMethod, m_index, args);
+	}
+}
+
+const CallPlan *MetaMethodSlotObject::plan(const CallSignature *signature)
+{
+	if (const CallPlan *plan = m_plans.find(signature))
+	{
+		return plan;
+	}
+	return m_plans.add(signature, makePlan(*signature));
+}
+
+static QString typeName(const int type)
+{
+	const char *name = QMetaType::typeName(type);
+	return name ? QString::fromLatin1(name) : QString("<unregistered type>");
+}
+
+CallPlan MetaMethodSlotObject::makePlan(const CallSignature &signature) const
+{
+	CallPlan plan = {false, QMetaType::UnknownType, QMetaType::UnknownType, nullptr};
+	QString error;
+	if (signature.count != m_parameterTypes.size())
+	{
+		error = QString("Incompatible argument count (expected %1, got %2)")
+					.arg(m_parameterTypes.size())
+					.arg(signature.count);
+	}
+	for (int i = 0; error.isNull() && i < signature.count; ++i)
+	{
+		// moc leaves types it doesn't know unregistered, there's nothing to check those against
+		if (m_parameterTypes[i] != QMetaType::UnknownType &&
+			signature.types[i] != m_parameterTypes[i])
+		{
+			error = QString("Argument %1 has type %2, expected %3")
+						.arg(i + 1)
+						.arg(typeName(signature.types[i]), typeName(m_parameterTypes[i]));
+		}
+	}
+	if (error.isNull() && signature.returnType != QMetaType::Void &&
+		signature.returnType != m_returnType)
+	{
+		if (signature.returnType == QMetaType::UnknownType)
+		{
+			error = "Requested return type is not registered, please use the "
+					"Q_DECLARE_METATYPE macro to make it known to Qt's meta-object system";
+		}
+		else if (m_returnType == QMetaType::Void ||
+				 !QMetaType::hasRegisteredConverterFunction(m_returnType, signature.returnType))
+		{
+			error = QString("Requested return type (%1) is incompatible with the method's "
+							"return type (%2)")
+						.arg(typeName(signature.returnType), typeName(m_returnType));
+		}
+		else
+		{
+			plan.convertFrom = m_returnType;
+			plan.convertTo = signature.returnType;
+		}
+	}
+
+	if (!error.isNull())
+	{
+		// checked in release builds too, as a mismatch would otherwise mean memory corruption
+		qWarning("Bindable: can't call %s: %s", m_signature.constData(), qPrintable(error));
+		return plan;
+	}
+	plan.valid = true;
+	return plan;
+}
+}
@@ -0,0 +1,369 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QMetaMethod>
+#include <QVector>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+namespace Detail
+{
+template <std::size_t... a> struct Sequence
+{
+};
+template <std::size_t N, std::size_t... S>
+struct SequenceGenerator : SequenceGenerator<N - 1, N - 1, S...>
+{
+};
+template <std::size_t... S> struct SequenceGenerator<0, S...>
+{
+	typedef Sequence<S...> type;
+};
+
+/**
+ * @brief Bit i is set if the i-th argument was passed as a (non-const) rvalue
+ *
+ * Callbacks may move from those arguments, but have to copy the others.
+ */
+template <typename... Params> struct MovableMask;
+template <> struct MovableMask<>
+{
+	static const uint value = 0;
+};
+template <typename P, typename... Rest> struct MovableMask<P, Rest...>
+{
+	static const uint value =
+		(std::is_lvalue_reference<P>::value ||
+				 std::is_const<typename std::remove_reference<P>::type>::value
+			 ? 0u
+			 : 1u) |
+		(MovableMask<Rest...>::value << 1);
+};
+
+template <typename T, bool Copyable = std::is_copy_constructible<T>::value> struct ValueArgument
+{
+	static T get(void *arg, const bool movable)
+	{
+		return movable ? T(std::move(*static_cast<T *>(arg))) : T(*static_cast<T *>(arg));
+	}
+};
+template <typename T> struct ValueArgument<T, false>
+{
+	// move-only types can only ever be handed over
+	static T get(void *arg, const bool)
+	{
+		return T(std::move(*static_cast<T *>(arg)));
+	}
+};
+
+/// Turns an entry of a type-erased argument array into what a parameter of type Arg expects
+template <typename Arg> struct Argument
+{
+	typedef typename std::decay<Arg>::type Type;
+	static Type get(void *arg, const bool movable)
+	{
+		return ValueArgument<Type>::get(arg, movable);
+	}
+};
+template <typename T> struct Argument<T &>
+{
+	static T &get(void *arg, const bool)
+	{
+		return *static_cast<T *>(arg);
+	}
+};
+template <typename T> struct Argument<T &&>
+{
+	static T &&get(void *arg, const bool)
+	{
+		return std::move(*static_cast<T *>(arg));
+	}
+};
+
+/**
+ * @brief Passes an argument on as it is, except arrays (string literals), which decay
+ *
+ * Arguments are passed by address, and the address of an array isn't that of a pointer.
+ */
+template <typename T> T &&decayArgument(T &&value)
+{
+	return std::forward<T>(value);
+}
+template <typename T, std::size_t N> T *decayArgument(T (&value)[N])
+{
+	return value;
+}
+
+template <typename Func, typename Ret,
+		  bool IsMember = QtPrivate::FunctionPointer<Func>::IsPointerToMemberFunction>
+struct Invoke
+{
+	template <typename... Args> static Ret call(Func func, QObject *receiver, Args &&... args)
+	{
+		typedef typename QtPrivate::FunctionPointer<Func>::Object Object;
+		return (static_cast<Object *>(receiver)->*func)(std::forward<Args>(args)...);
+	}
+};
+template <typename Func, typename Ret> struct Invoke<Func, Ret, false>
+{
+	template <typename... Args> static Ret call(Func func, QObject *, Args &&... args)
+	{
+		return func(std::forward<Args>(args)...);
+	}
+};
+
+template <typename Ret> struct StoreResult
+{
+	template <typename Func, typename... Args>
+	static void call(void *result, Func func, QObject *receiver, Args &&... args)
+	{
+		if (result)
+		{
+			*static_cast<typename std::decay<Ret>::type *>(result) =
+				Invoke<Func, Ret>::call(func, receiver, std::forward<Args>(args)...);
+		}
+		else
+		{
+			Invoke<Func, Ret>::call(func, receiver, std::forward<Args>(args)...);
+		}
+	}
+};
+template <> struct StoreResult<void>
+{
+	template <typename Func, typename... Args>
+	static void call(void *, Func func, QObject *receiver, Args &&... args)
+	{
+		Invoke<Func, void>::call(func, receiver, std::forward<Args>(args)...);
+	}
+};
+
+/// The meta type id of T, or QMetaType::UnknownType if T isn't known to the meta type system
+template <typename T, bool Defined = QMetaTypeId2<T>::Defined> struct OptionalMetaTypeId
+{
+	static int get()
+	{
+		return qMetaTypeId<T>();
+	}
+};
+template <typename T> struct OptionalMetaTypeId<T, false>
+{
+	static int get()
+	{
+		return QMetaType::UnknownType;
+	}
+};
+
+/// The types a call site passes and expects back
+struct CallSignature
+{
+	int returnType;
+	int count;
+	const int *types;
+};
+/// One CallSignature per call site signature, so its address identifies it
+template <typename Ret, typename... Params> struct CallSignatureFor
+{
+	static const CallSignature *get()
+	{
+		static const int types[] = {
+			0, OptionalMetaTypeId<typename std::decay<Params>::type>::get()...};
+		static const CallSignature signature = {OptionalMetaTypeId<Ret>::get(),
+												int(sizeof...(Params)), types + 1};
+		return &signature;
+	}
+};
+
+/**
+ * @brief The signature of calls whose types are only known at runtime
+ *
+ * Plans are cached by the address of their signature, so these are never freed; there's one
+ * per distinct list of types.
+ */
+const CallSignature *internSignature(const int returnType, const QVector<int> &types);
+
+/// How calls with a given @ref CallSignature have to be made
+struct CallPlan
+{
+	/// False if the callback can't be called with that signature at all
+	bool valid;
+	/// If not QMetaType::UnknownType, the callback returns this type, which has to be converted
+	int convertFrom;
+	int convertTo;
+	/// If set, the call has to be made through @ref SlotObjectBase::marshal with this signature
+	const CallSignature *signature;
+
+	/// Calls that can be made as they are
+	static const CallPlan *direct();
+};
+
+/// Plans per call site signature; only ever prepended to, so lookups don't need a lock
+class PlanList
+{
+	Q_DISABLE_COPY(PlanList)
+public:
+	PlanList()
+	{
+	}
+	~PlanList();
+
+	const CallPlan *find(const CallSignature *signature) const;
+	/// Two threads racing to add a plan for the same signature both add it, which is harmless
+	const CallPlan *add(const CallSignature *signature, const CallPlan &plan);
+
+private:
+	struct Entry
+	{
+		const CallSignature *m_signature;
+		CallPlan m_plan;
+		Entry *m_next;
+	};
+	std::atomic<Entry *> m_head{nullptr};
+};
+
+/**
+ * @brief Type-erased, reference counted callback
+ *
+ * Like Qt's own slot objects, but arguments passed as rvalues are moved into by-value
+ * parameters instead of being copied, which also makes move-only argument types work.
+ */
+class SlotObjectBase
+{
+	Q_DISABLE_COPY(SlotObjectBase)
+public:
+	SlotObjectBase() : m_ref(1)
+	{
+	}
+	virtual ~SlotObjectBase()
+	{
+	}
+
+	void ref()
+	{
+		m_ref.ref();
+	}
+	void destroyIfLastRef()
+	{
+		if (!m_ref.deref())
+		{
+			delete this;
+		}
+	}
+
+	/**
+	 * @param args    args[0] points to storage for the return value (or is null), args[i + 1]
+	 * to the i-th argument
+	 * @param movable See @ref MovableMask
+	 */
+	virtual void call(QObject *receiver, void **args, const uint movable) = 0;
+	/**
+	 * @brief Checks whether, and how, calls with the given signature can be made
+	 *
+	 * The default is for callbacks whose types were checked by the compiler already.
+	 */
+	virtual const CallPlan *plan(const CallSignature *signature)
+	{
+		Q_UNUSED(signature)
+		return CallPlan::direct();
+	}
+	/// Like @ref call, for callbacks whose plans ask for the call site's signature
+	virtual void marshal(void **args, const CallSignature &signature)
+	{
+		Q_UNUSED(args)
+		Q_UNUSED(signature)
+	}
+	/// The callback's own parameter and return types, if the compiler knows them
+	virtual const CallSignature *signature() const
+	{
+		return nullptr;
+	}
+
+private:
+	QAtomicInt m_ref;
+};
+
+template <typename Func, typename Args, typename Ret> class SlotObject;
+template <typename Func, typename... Args, typename Ret>
+class SlotObject<Func, QtPrivate::List<Args...>, Ret> : public SlotObjectBase
+{
+public:
+	explicit SlotObject(Func func) : m_func(func)
+	{
+	}
+
+	void call(QObject *receiver, void **args, const uint movable) override
+	{
+		call(receiver, args, movable, typename SequenceGenerator<sizeof...(Args)>::type());
+	}
+	const CallSignature *signature() const override
+	{
+		return CallSignatureFor<typename std::decay<Ret>::type, Args...>::get();
+	}
+
+private:
+	Func m_func;
+
+	template <std::size_t... I>
+	void call(QObject *receiver, void **args, const uint movable, Sequence<I...>)
+	{
+		StoreResult<Ret>::call(args[0], m_func, receiver,
+							   Argument<Args>::get(args[I + 1], movable & (1u << I))...);
+	}
+};
+
+/**
+ * @brief Calls a meta method through its meta-object, with the argument array as given
+ *
+ * Everything that can be is resolved on construction, so calling only costs an indirect call
+ * into the moc generated dispatcher.
+ *
+ * The method's signature is checked against each call site's the first time that call site
+ * is used; the resulting @ref CallPlan, including any return type conversion, is kept for all
+ * later calls from there.
+ */
+class MetaMethodSlotObject : public SlotObjectBase
+{
+public:
+	explicit MetaMethodSlotObject(const QMetaMethod &method);
+	~MetaMethodSlotObject();
+
+	void call(QObject *receiver, void **args, const uint movable) override;
+	const CallPlan *plan(const CallSignature *signature) override;
+
+private:
+	typedef void (*StaticMetacall)(QObject *, QMetaObject::Call, int, void **);
+	StaticMetacall m_staticMetacall;
+	int m_index;
+	int m_localIndex;
+
+	QByteArray m_signature;
+	int m_returnType;
+	QVector<int> m_parameterTypes;
+
+	PlanList m_plans;
+
+	CallPlan makePlan(const CallSignature &signature) const;
+};
+
+template <typename Func> SlotObjectBase *makeSlotObject(Func func)
+{
+	typedef QtPrivate::FunctionPointer<Func> SlotType;
+	return new SlotObject<Func, typename SlotType::Arguments, typename SlotType::ReturnType>(
+		func);
+}
+}
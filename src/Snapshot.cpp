@@ -0,0 +1,62 @@
+#include "Snapshot.h"
+
+#include <QThread>
+
+namespace Detail
+{
+static std::atomic<int> liveVersions{0};
+
+SnapshotVersion::SnapshotVersion() : m_refs(1)
+{
+	liveVersions.fetch_add(1, std::memory_order_relaxed);
+}
+SnapshotVersion::~SnapshotVersion()
+{
+	liveVersions.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int SnapshotVersion::liveCount()
+{
+	return liveVersions.load();
+}
+
+ReaderCounter::ReaderCounter() : m_epoch(0)
+{
+}
+
+std::atomic<int> *ReaderCounter::enter()
+{
+	// thread handles are usually aligned, so mix the bits before picking a stripe
+	quintptr id = quintptr(QThread::currentThreadId());
+	id ^= id >> 16;
+	id *= 0x45d9f3bu;
+	id ^= id >> 16;
+	forever
+	{
+		// a reader that still sees its epoch after entering is one the writer that flips it
+		// next waits for; otherwise it might have been missed and has to enter again
+		const int epoch = m_epoch.load();
+		std::atomic<int> *count = &m_stripes[epoch][id % Stripes].count;
+		count->fetch_add(1);
+		if (m_epoch.load() == epoch)
+		{
+			return count;
+		}
+		leave(count);
+	}
+}
+
+void ReaderCounter::synchronize()
+{
+	// only called by writers, which the cell serializes
+	const int epoch = m_epoch.load();
+	m_epoch.store(1 - epoch);
+	for (const Stripe &stripe : m_stripes[epoch])
+	{
+		while (stripe.count.load() != 0)
+		{
+			QThread::yieldCurrentThread();
+		}
+	}
+}
+}
@@ -0,0 +1,215 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <atomic>
+#include <utility>
+
+namespace Detail
+{
+/**
+ * @brief One published version of a @ref SnapshotCell, freed when its last reference goes
+ *
+ * The cell holds a reference to its current version, and every @ref ReaderLock holds one to
+ * the version it was taken from.
+ */
+class SnapshotVersion
+{
+	Q_DISABLE_COPY(SnapshotVersion)
+public:
+	SnapshotVersion();
+	virtual ~SnapshotVersion();
+
+	void acquire()
+	{
+		m_refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	void release()
+	{
+		if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete this;
+		}
+	}
+
+	/// The number of versions, over all cells, that haven't been freed yet
+	static int liveCount();
+
+private:
+	std::atomic<int> m_refs;
+};
+
+/**
+ * @brief Keeps one version of a @ref SnapshotCell alive until destroyed
+ */
+class ReaderLock
+{
+	Q_DISABLE_COPY(ReaderLock)
+public:
+	ReaderLock() : m_version(nullptr)
+	{
+	}
+	/// Adopts a reference the caller already holds on version
+	explicit ReaderLock(SnapshotVersion *version) : m_version(version)
+	{
+	}
+	ReaderLock(ReaderLock &&other) : m_version(other.m_version)
+	{
+		other.m_version = nullptr;
+	}
+	ReaderLock &operator=(ReaderLock &&other)
+	{
+		std::swap(m_version, other.m_version);
+		return *this;
+	}
+	~ReaderLock()
+	{
+		if (m_version)
+		{
+			m_version->release();
+		}
+	}
+
+private:
+	SnapshotVersion *m_version;
+};
+
+/**
+ * @brief Counts readers between loading a version and taking their reference to it
+ *
+ * The counters are striped over several cache lines, so readers on different threads mostly
+ * touch different ones and taking a snapshot doesn't bounce a shared line between cores.
+ * There are two sets of them: a writer flips new readers over to the other set and only waits
+ * for the set it flipped away from, so a steady stream of readers can't starve it.
+ */
+class ReaderCounter
+{
+public:
+	ReaderCounter();
+
+	/// Enters a read section, returns the counter to leave it through
+	std::atomic<int> *enter();
+	static void leave(std::atomic<int> *count)
+	{
+		count->fetch_sub(1, std::memory_order_release);
+	}
+
+	/// Waits until every reader that entered before the call has left again
+	void synchronize();
+
+private:
+	enum
+	{
+		Stripes = 8
+	};
+	struct alignas(64) Stripe
+	{
+		std::atomic<int> count{0};
+	};
+	Stripe m_stripes[2][Stripes];
+	std::atomic<int> m_epoch;
+};
+
+/**
+ * @brief A reference to one published version of a @ref SnapshotCell
+ */
+template <typename T> class Snapshot
+{
+public:
+	Snapshot(ReaderLock &&lock, const T *data) : m_lock(std::move(lock)), m_data(data)
+	{
+	}
+	Snapshot(Snapshot &&other) : m_lock(std::move(other.m_lock)), m_data(other.m_data)
+	{
+	}
+
+	const T *operator->() const
+	{
+		return m_data;
+	}
+	const T &operator*() const
+	{
+		return *m_data;
+	}
+
+	/// Hands the reference over to somebody that keeps pointing into this version
+	ReaderLock takeLock()
+	{
+		return std::move(m_lock);
+	}
+
+private:
+	ReaderLock m_lock;
+	const T *m_data;
+};
+
+/**
+ * @brief Holds a value that's read lock-free and replaced by copy-on-write
+ *
+ * Readers get an immutable version that stays valid for as long as they hold its
+ * @ref Snapshot, even if a writer publishes a new one in the meantime. Every version is
+ * reference counted, so the one a reader keeps across a long wait doesn't hold back the
+ * versions published after it. Writers are serialized by a mutex.
+ */
+template <typename T> class SnapshotCell
+{
+	Q_DISABLE_COPY(SnapshotCell)
+public:
+	SnapshotCell() : m_current(new Version(T()))
+	{
+	}
+	~SnapshotCell()
+	{
+		m_current.load()->release();
+	}
+
+	Snapshot<T> read() const
+	{
+		// the section only spans loading the version and taking the reference, which is all
+		// a writer has to wait out before dropping the reference the cell held
+		std::atomic<int> *section = m_readers.enter();
+		Version *version = m_current.load();
+		version->acquire();
+		ReaderCounter::leave(section);
+		return Snapshot<T>(ReaderLock(version), &version->value);
+	}
+
+	/// Calls func with a private copy of the current value, then publishes the copy
+	template <typename Func> void update(Func func)
+	{
+		QMutexLocker locker(&m_writeMutex);
+		Version *next = new Version(m_current.load()->value);
+		func(next->value);
+		Version *previous = m_current.exchange(next);
+		m_readers.synchronize();
+		previous->release();
+	}
+
+private:
+	struct Version : public SnapshotVersion
+	{
+		explicit Version(const T &value) : value(value)
+		{
+		}
+		T value;
+	};
+
+	std::atomic<Version *> m_current;
+	mutable ReaderCounter m_readers;
+	QMutex m_writeMutex;
+};
+}
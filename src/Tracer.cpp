@@ -0,0 +1,295 @@
+#include "Tracer.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QHash>
+#include <QThread>
+#include <QVector>
+#include <QCoreApplication>
+#include <algorithm>
+#include <chrono>
+
+namespace Detail
+{
+namespace
+{
+/// Marks a slot a writer has claimed, see Tracer::record()
+const quint64 Writing = ~quint64(0);
+
+struct Event
+{
+	/// Index of the event plus one, 0 if empty, Writing while it's being written
+	std::atomic<quint64> sequence{0};
+	std::atomic<qint64> timestamp{0};
+	std::atomic<quint64> call{0};
+	std::atomic<quintptr> thread{0};
+	std::atomic<int> name{0};
+	std::atomic<int> kind{0};
+};
+
+struct Buffer
+{
+	explicit Buffer(const int capacity) : events(new Event[capacity]), mask(capacity - 1)
+	{
+	}
+	~Buffer()
+	{
+		delete[] events;
+	}
+	/// Waits for the writers that got in before recording was turned off, and empties it
+	void reset()
+	{
+		while (writers.load() != 0)
+		{
+			QThread::yieldCurrentThread();
+		}
+		next.store(0);
+		for (quint64 i = 0; i <= mask; ++i)
+		{
+			events[i].sequence.store(0);
+		}
+	}
+
+	Event *events;
+	quint64 mask;
+	std::atomic<quint64> next{0};
+	/// Threads inside record() that may still be writing to this buffer
+	std::atomic<int> writers{0};
+};
+
+struct NameList
+{
+	QMutex mutex;
+	QHash<QString, int> ids;
+	QVector<QString> names;
+};
+}
+
+Q_GLOBAL_STATIC(NameList, names)
+std::atomic<bool> Tracer::s_enabled{false};
+static std::atomic<Buffer *> s_buffer{nullptr};
+static std::atomic<quint64> s_calls{0};
+/// Buffers that were replaced by one of another size; kept for reuse rather than freed, as
+/// a writer that loaded one just before may still be about to touch it
+static QVector<Buffer *> s_retired;
+/// Serializes start(), stop() and toJson(), so a dump never reads a buffer being reset
+static QMutex s_controlMutex;
+
+static qint64 now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::start(const int capacity)
+{
+	int size = 1;
+	while (size < capacity)
+	{
+		size *= 2;
+	}
+	QMutexLocker locker(&s_controlMutex);
+	// anybody entering record() from now on sees the flag cleared and leaves without writing
+	s_enabled.store(false);
+	Buffer *buffer = s_buffer.load();
+	if (buffer && int(buffer->mask + 1) != size)
+	{
+		s_retired.append(buffer);
+		buffer = nullptr;
+	}
+	for (int i = 0; !buffer && i < s_retired.size(); ++i)
+	{
+		if (int(s_retired[i]->mask + 1) == size)
+		{
+			buffer = s_retired.takeAt(i);
+		}
+	}
+	if (!buffer)
+	{
+		buffer = new Buffer(size);
+	}
+	// only waits for writers still on the buffer that's reused, not for those on any other
+	buffer->reset();
+	s_buffer.store(buffer);
+	s_enabled.store(true);
+}
+void Tracer::stop()
+{
+	// writers still at it finish their slots, which a dump skips until then
+	QMutexLocker locker(&s_controlMutex);
+	s_enabled.store(false);
+}
+
+int Tracer::nameId(const QString &id)
+{
+	QMutexLocker locker(&names()->mutex);
+	auto it = names()->ids.constFind(id);
+	if (it != names()->ids.constEnd())
+	{
+		return it.value();
+	}
+	names()->names.append(id);
+	return names()->ids.insert(id, names()->names.size() - 1).value();
+}
+
+QString Tracer::name(const int id)
+{
+	QMutexLocker locker(&names()->mutex);
+	return names()->names.value(id);
+}
+
+quint64 Tracer::newCall()
+{
+	return s_calls.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void Tracer::record(const Kind kind, const int name, const quint64 call)
+{
+	// checked again after entering, as start() or stop() may have come in between the
+	// caller's isEnabled() and here; start() doesn't reset a buffer until it has been left
+	Buffer *buffer = s_buffer.load(std::memory_order_acquire);
+	if (!buffer)
+	{
+		return;
+	}
+	buffer->writers.fetch_add(1);
+	if (!s_enabled.load() || s_buffer.load() != buffer)
+	{
+		buffer->writers.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+	const quint64 index = buffer->next.fetch_add(1, std::memory_order_relaxed);
+	Event &event = buffer->events[index & buffer->mask];
+	// one writer per slot at a time: if the buffer wrapped around onto a slot that's still
+	// being written, this event is dropped rather than mixed into that one
+	quint64 previous = event.sequence.load(std::memory_order_relaxed);
+	do
+	{
+		if (previous == Writing)
+		{
+			buffer->writers.fetch_sub(1, std::memory_order_release);
+			return;
+		}
+	} while (!event.sequence.compare_exchange_weak(previous, Writing,
+													std::memory_order_relaxed));
+	std::atomic_thread_fence(std::memory_order_release);
+	event.timestamp.store(now(), std::memory_order_relaxed);
+	event.call.store(call, std::memory_order_relaxed);
+	event.thread.store(quintptr(QThread::currentThreadId()), std::memory_order_relaxed);
+	event.name.store(name, std::memory_order_relaxed);
+	event.kind.store(kind, std::memory_order_relaxed);
+	event.sequence.store(index + 1, std::memory_order_release);
+	buffer->writers.fetch_sub(1, std::memory_order_release);
+}
+
+namespace
+{
+struct Copy
+{
+	quint64 sequence;
+	qint64 timestamp;
+	quint64 call;
+	quintptr thread;
+	int name;
+	int kind;
+
+	bool operator<(const Copy &other) const
+	{
+		return sequence < other.sequence;
+	}
+};
+}
+
+static QJsonObject traceEvent(const Copy &event, const QString &name, const char *phase)
+{
+	QJsonObject object;
+	object.insert("name", name);
+	object.insert("ph", QString::fromLatin1(phase));
+	object.insert("ts", double(event.timestamp) / 1000.0);
+	object.insert("pid", double(QCoreApplication::applicationPid()));
+	object.insert("tid", double(event.thread));
+	return object;
+}
+static QJsonObject asyncEvent(const Copy &event, const QString &name, const char *phase,
+							  const char *category)
+{
+	QJsonObject object = traceEvent(event, name, phase);
+	object.insert("cat", QString::fromLatin1(category));
+	object.insert("id", QString::number(event.call));
+	return object;
+}
+
+QByteArray Tracer::toJson()
+{
+	QVector<Copy> events;
+	QMutexLocker locker(&s_controlMutex);
+	if (Buffer *buffer = s_buffer.load(std::memory_order_acquire))
+	{
+		events.reserve(int(buffer->mask + 1));
+		for (quint64 i = 0; i <= buffer->mask; ++i)
+		{
+			const Event &event = buffer->events[i];
+			Copy copy;
+			copy.sequence = event.sequence.load(std::memory_order_acquire);
+			copy.timestamp = event.timestamp.load(std::memory_order_relaxed);
+			copy.call = event.call.load(std::memory_order_relaxed);
+			copy.thread = event.thread.load(std::memory_order_relaxed);
+			copy.name = event.name.load(std::memory_order_relaxed);
+			copy.kind = event.kind.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			// a slot that's being written, or was rewritten while it was copied, is skipped
+			if (copy.sequence != 0 && copy.sequence != Writing &&
+				copy.sequence == event.sequence.load(std::memory_order_relaxed))
+			{
+				events.append(copy);
+			}
+		}
+	}
+	locker.unlock();
+	std::sort(events.begin(), events.end());
+
+	QVector<QString> nameList;
+	{
+		QMutexLocker locker(&names()->mutex);
+		nameList = names()->names;
+	}
+
+	QJsonArray array;
+	for (const Copy &event : events)
+	{
+		const QString name = nameList.value(event.name);
+		switch (event.kind)
+		{
+		case WaitBegin:
+			array.append(traceEvent(event, name, "B"));
+			break;
+		case WaitEnd:
+			array.append(traceEvent(event, name, "E"));
+			break;
+		case Enqueue:
+			// the time spent in the receiver's queue, and an arrow to where it ran
+			array.append(asyncEvent(event, "queued " + name, "b", "queue"));
+			array.append(asyncEvent(event, name, "s", "dispatch"));
+			break;
+		case Start:
+		{
+			array.append(asyncEvent(event, "queued " + name, "e", "queue"));
+			QJsonObject flowEnd = asyncEvent(event, name, "f", "dispatch");
+			flowEnd.insert("bp", QString("e"));
+			array.append(flowEnd);
+			array.append(traceEvent(event, "run " + name, "B"));
+			break;
+		}
+		case Finish:
+			array.append(traceEvent(event, "run " + name, "E"));
+			break;
+		}
+	}
+	QJsonObject root;
+	root.insert("traceEvents", array);
+	root.insert("displayTimeUnit", QString("ns"));
+	return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+}
@@ -0,0 +1,70 @@
+/* Copyright 2014 Jan Dalheimer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+
+namespace Detail
+{
+/**
+ * @brief Records dispatches into a fixed size ring buffer, for viewing them on a timeline
+ *
+ * Writers claim a slot with a single atomic increment and never block; once the buffer is
+ * full the oldest events are overwritten. Each slot carries a sequence number that marks it
+ * while it's being written, so only one writer fills it at a time and a dump taken while calls
+ * are still going on skips the slots it would otherwise see half written. Each buffer counts
+ * its own writers, and @ref start only waits for those of the buffer it's about to reset.
+ * Buffers are never freed, only reused.
+ *
+ * While tracing is off, recording costs a single relaxed load.
+ */
+class Tracer
+{
+public:
+	enum Kind
+	{
+		/// A wait() call on the calling thread
+		WaitBegin,
+		WaitEnd,
+		/// A call posted to another thread, and that thread running it
+		Enqueue,
+		Start,
+		Finish
+	};
+
+	static void start(const int capacity);
+	static void stop();
+	static bool isEnabled()
+	{
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+
+	/// Chrome trace-event JSON of what's currently in the buffer
+	static QByteArray toJson();
+
+	/// Callback IDs are only interned once, at bind time; events refer to them by number
+	static int nameId(const QString &id);
+	static QString name(const int id);
+	/// Identifies the events belonging to one dispatched call
+	static quint64 newCall();
+	static void record(const Kind kind, const int name, const quint64 call);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+}
@@ -0,0 +1,287 @@
+#include <QTest>
+#include <QThread>
+#include <QThreadPool>
+#include <QFuture>
+#include <string>
+
+#include <LogicalGui.h>
+
+class BenchTarget : public QObject
+{
+	Q_OBJECT
+public:
+	explicit BenchTarget(QObject *parent = nullptr) : QObject(parent)
+	{
+	}
+
+	// not a slot, moc can't handle std::string
+	int payload(const std::string &data)
+	{
+		return int(data.size());
+	}
+
+public slots:
+	void noop()
+	{
+	}
+	int echo(int value)
+	{
+		return value;
+	}
+};
+
+static int echo(int value)
+{
+	return value;
+}
+
+class BenchBindable : public Bindable
+{
+public:
+	using Bindable::Bindable;
+	using Bindable::wait;
+	using Bindable::request;
+};
+
+class CallRunner : public QRunnable
+{
+public:
+	CallRunner(BenchBindable *bindable, const int count) : m_bindable(bindable), m_count(count)
+	{
+	}
+	void run() override
+	{
+		for (int i = 0; i < m_count; ++i)
+		{
+			m_bindable->wait<int>("Echo", i);
+		}
+	}
+
+private:
+	BenchBindable *m_bindable;
+	int m_count;
+};
+
+/**
+ * Run with "-o bench_LogicalGui.xml,xml" (or use the bench target) to get results that can be
+ * compared across releases.
+ */
+class bench_LogicalGui : public QObject
+{
+	Q_OBJECT
+
+	QThread *m_thread = nullptr;
+	BenchTarget *m_local = nullptr;
+	BenchTarget *m_remote = nullptr;
+
+	BenchTarget *target(const bool crossThread) const
+	{
+		return crossThread ? m_remote : m_local;
+	}
+
+private slots:
+	void initTestCase()
+	{
+		m_local = new BenchTarget;
+		m_remote = new BenchTarget;
+		m_thread = new QThread;
+		m_thread->start();
+		m_remote->moveToThread(m_thread);
+	}
+	void cleanupTestCase()
+	{
+		m_thread->quit();
+		m_thread->wait();
+		delete m_local, m_remote, m_thread;
+	}
+
+	void waitLatency_data()
+	{
+		QTest::addColumn<bool>("slotString");
+		QTest::addColumn<bool>("crossThread");
+		QTest::newRow("pointer, same thread") << false << false;
+		QTest::newRow("SLOT, same thread") << true << false;
+		QTest::newRow("pointer, cross thread") << false << true;
+		QTest::newRow("SLOT, cross thread") << true << true;
+	}
+	void waitLatency()
+	{
+		QFETCH(bool, slotString);
+		QFETCH(bool, crossThread);
+		BenchBindable bindable;
+		if (slotString)
+		{
+			bindable.bind("Echo", target(crossThread), SLOT(echo(int)));
+		}
+		else
+		{
+			bindable.bind("Echo", target(crossThread), &BenchTarget::echo);
+		}
+
+		int sum = 0;
+		QBENCHMARK
+		{
+			sum += bindable.wait<int>("Echo", 1);
+		}
+		QVERIFY(sum > 0);
+	}
+
+	void parentDepth_data()
+	{
+		QTest::addColumn<int>("depth");
+		for (const int depth : {0, 1, 4, 16})
+		{
+			QTest::newRow(qPrintable(QString("depth %1").arg(depth))) << depth;
+		}
+	}
+	void parentDepth()
+	{
+		QFETCH(int, depth);
+		QList<BenchBindable *> chain;
+		chain.append(new BenchBindable);
+		chain.first()->bind("Noop", m_local, &BenchTarget::noop);
+		for (int i = 0; i < depth; ++i)
+		{
+			chain.append(new BenchBindable(chain.last()));
+		}
+
+		BenchBindable *leaf = chain.last();
+		QBENCHMARK
+		{
+			leaf->wait<void>("Noop");
+		}
+
+		// children first, they unregister from their parents
+		while (!chain.isEmpty())
+		{
+			delete chain.takeLast();
+		}
+	}
+
+	void requestLatency_data()
+	{
+		QTest::addColumn<bool>("crossThread");
+		QTest::newRow("same thread") << false;
+		QTest::newRow("cross thread") << true;
+	}
+	void requestLatency()
+	{
+		QFETCH(bool, crossThread);
+		BenchBindable bindable;
+		bindable.bind("Echo", target(crossThread), &BenchTarget::echo);
+
+		int sum = 0;
+		QBENCHMARK
+		{
+			sum += bindable.request<int>("Echo", 1).result();
+		}
+		QVERIFY(sum > 0);
+	}
+
+	void requestThroughput_data()
+	{
+		QTest::addColumn<int>("count");
+		QTest::newRow("100 in flight") << 100;
+		QTest::newRow("10000 in flight") << 10000;
+	}
+	void requestThroughput()
+	{
+		QFETCH(int, count);
+		BenchBindable bindable;
+		bindable.bind("Echo", m_remote, &BenchTarget::echo);
+
+		QVector<QFuture<int>> futures(count);
+		QBENCHMARK
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				futures[i] = bindable.request<int>("Echo", i);
+			}
+			for (int i = 0; i < count; ++i)
+			{
+				futures[i].waitForFinished();
+			}
+		}
+	}
+
+	void concurrentCallers_data()
+	{
+		QTest::addColumn<int>("threads");
+		QTest::addColumn<bool>("crossThread");
+		for (const int threads : {1, 2, 4, 8, 16})
+		{
+			QTest::newRow(qPrintable(QString("%1 threads, no receiver").arg(threads)))
+				<< threads << false;
+			QTest::newRow(qPrintable(QString("%1 threads, cross thread").arg(threads)))
+				<< threads << true;
+		}
+	}
+	/// Each row makes 1000 calls per caller thread
+	void concurrentCallers()
+	{
+		QFETCH(int, threads);
+		QFETCH(bool, crossThread);
+		BenchBindable bindable;
+		if (crossThread)
+		{
+			bindable.bind("Echo", m_remote, &BenchTarget::echo);
+		}
+		else
+		{
+			// without a receiver every caller calls it directly
+			bindable.bind("Echo", &echo);
+		}
+
+		QThreadPool pool;
+		pool.setMaxThreadCount(threads);
+		QBENCHMARK
+		{
+			for (int i = 0; i < threads; ++i)
+			{
+				pool.start(new CallRunner(&bindable, 1000));
+			}
+			pool.waitForDone();
+		}
+	}
+
+	void payload_data()
+	{
+		QTest::addColumn<int>("size");
+		QTest::addColumn<bool>("useRequest");
+		for (const int size : {0, 64, 4096, 1 << 20})
+		{
+			QTest::newRow(qPrintable(QString("wait, %1 bytes").arg(size))) << size << false;
+			QTest::newRow(qPrintable(QString("request, %1 bytes").arg(size))) << size << true;
+		}
+	}
+	/// Cross thread; wait passes the argument by reference, request has to copy it
+	void payload()
+	{
+		QFETCH(int, size);
+		QFETCH(bool, useRequest);
+		BenchBindable bindable;
+		bindable.bind("Payload", m_remote, &BenchTarget::payload);
+		const std::string data(size, 'x');
+
+		int total = 0;
+		if (useRequest)
+		{
+			QBENCHMARK
+			{
+				total += bindable.request<int>("Payload", data).result();
+			}
+		}
+		else
+		{
+			QBENCHMARK
+			{
+				total += bindable.wait<int>("Payload", data);
+			}
+		}
+		QVERIFY(size == 0 || total > 0);
+	}
+};
+
+QTEST_GUILESS_MAIN(bench_LogicalGui)
+
+#include "bench_LogicalGui.moc"
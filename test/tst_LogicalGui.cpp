@@ -2,9 +2,58 @@
 #include <QThread>
 #include <QFuture>
 #include <QMutex>
+#include <QThreadPool>
+#include <QCoreApplication>
+#include <QPoint>
+#include <QSemaphore>
+#include <QBuffer>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <memory>
 
 #include <LogicalGui.h>
 
+struct CopyCounter
+{
+	static int copies;
+	CopyCounter()
+	{
+	}
+	CopyCounter(const CopyCounter &)
+	{
+		copies++;
+	}
+	CopyCounter(CopyCounter &&)
+	{
+	}
+	CopyCounter &operator=(const CopyCounter &)
+	{
+		copies++;
+		return *this;
+	}
+	CopyCounter &operator=(CopyCounter &&)
+	{
+		return *this;
+	}
+};
+int CopyCounter::copies = 0;
+
+struct HitCount
+{
+	int value = 0;
+};
+Q_DECLARE_METATYPE(HitCount)
+static HitCount toHitCount(const int &value)
+{
+	HitCount count;
+	count.value = value;
+	return count;
+}
+
 class TestTarget : public QObject
 {
 	Q_OBJECT
@@ -15,12 +64,51 @@ public:
 
 	int numHits = 0;
 	QMutex mutex;
+	/// Released by hold() once it's running, and acquired by it before it returns
+	QSemaphore entered, proceed;
 
 	void reset()
 	{
 		numHits = 0;
 	}
 
+	// not slots, moc can't handle these argument types
+	int takeOwnership(std::unique_ptr<int> value)
+	{
+		return *value;
+	}
+	int byReference(const CopyCounter &)
+	{
+		return ++numHits;
+	}
+	int byValue(CopyCounter)
+	{
+		return ++numHits;
+	}
+	QThread *runningThread()
+	{
+		return QThread::currentThread();
+	}
+	/// Keeps the receiver's thread busy until the test lets it go on
+	void hold()
+	{
+		entered.release();
+		proceed.acquire();
+		hit();
+	}
+	/// Runs a nested event loop, like a modal dialog would, until hit() is called from it
+	bool spinUntilHit()
+	{
+		QEventLoop loop;
+		QElapsedTimer timer;
+		timer.start();
+		while (numHits == 0 && timer.elapsed() < 5000)
+		{
+			loop.processEvents(QEventLoop::AllEvents, 10);
+		}
+		return numHits > 0;
+	}
+
 public slots:
 	void hit()
 	{
@@ -44,6 +132,68 @@ public slots:
 		numHits += num;
 		return numHits;
 	}
+	int hitAndMeasure(const char *text)
+	{
+		QMutexLocker locker(&mutex);
+		numHits++;
+		return int(qstrlen(text));
+	}
+};
+
+class TestBindable : public Bindable
+{
+public:
+	using Bindable::wait;
+	using Bindable::waitFor;
+	using Bindable::request;
+};
+
+// plain functions for executors(), callbacks without a receiver
+static QThread *callingThread()
+{
+	return QThread::currentThread();
+}
+static QSemaphore s_started, s_proceed;
+static bool meetInParallel()
+{
+	s_started.release();
+	return s_proceed.tryAcquire(1, 5000);
+}
+static QAtomicInt s_running, s_overlaps;
+static QVector<int> s_order;
+static void runSerially(int value)
+{
+	if (s_running.fetchAndAddOrdered(1) != 0)
+	{
+		s_overlaps.ref();
+	}
+	s_order.append(value);
+	QThread::usleep(100);
+	s_running.deref();
+}
+
+static QString greet(const QString &name)
+{
+	return "Hello " + name;
+}
+
+class WaitRunner : public QRunnable
+{
+public:
+	WaitRunner(TestBindable *bindable, const int count) : m_bindable(bindable), m_count(count)
+	{
+	}
+	void run() override
+	{
+		for (int i = 0; i < m_count; ++i)
+		{
+			m_bindable->wait<void>("Hit");
+		}
+	}
+
+private:
+	TestBindable *m_bindable;
+	int m_count;
 };
 
 class tst_LogicalGui : public QObject
@@ -52,6 +202,7 @@ class tst_LogicalGui : public QObject
 private slots:
 	void initTestCase()
 	{
+		QMetaType::registerConverter<int, HitCount>(&toHitCount);
 	}
 	void cleanupTestCase()
 	{
@@ -78,6 +229,56 @@ private slots:
 
 		delete bindable, target;
 	}
+	void slotReturnConversion()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitMultipleAndReturn", target, SLOT(hitMultipleAndReturn(int)));
+
+		QCOMPARE(bindable->wait<HitCount>("HitMultipleAndReturn", 2).value, 2);
+
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		QCOMPARE(bindable->wait<HitCount>("HitMultipleAndReturn", 3).value, 5);
+		QCOMPARE(bindable->request<HitCount>("HitMultipleAndReturn", 4).result().value, 9);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void callSignatureChecks()
+	{
+		TestTarget *target = new TestTarget;
+		const QMetaObject *mo = target->metaObject();
+		Detail::MetaMethodSlotObject *object = new Detail::MetaMethodSlotObject(
+			mo->method(mo->indexOfMethod("hitMultipleAndReturn(int)")));
+
+		const Detail::CallPlan *plan = object->plan(Detail::CallSignatureFor<int, int>::get());
+		QVERIFY(plan->valid);
+		QCOMPARE(plan->convertFrom, int(QMetaType::UnknownType));
+		QCOMPARE(object->plan(Detail::CallSignatureFor<int, int>::get()), plan);
+		QVERIFY(object->plan(Detail::CallSignatureFor<void, const int &>::get())->valid);
+
+		plan = object->plan(Detail::CallSignatureFor<HitCount, int>::get());
+		QVERIFY(plan->valid);
+		QCOMPARE(plan->convertFrom, int(QMetaType::Int));
+		QCOMPARE(plan->convertTo, qMetaTypeId<HitCount>());
+
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: can't call hitMultipleAndReturn(int): "
+											"Incompatible argument count (expected 1, got 0)");
+		QVERIFY(!object->plan(Detail::CallSignatureFor<int>::get())->valid);
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: can't call hitMultipleAndReturn(int): "
+											"Argument 1 has type QString, expected int");
+		QVERIFY(!object->plan(Detail::CallSignatureFor<int, QString>::get())->valid);
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: can't call hitMultipleAndReturn(int): "
+											"Requested return type (QPoint) is incompatible with "
+											"the method's return type (int)");
+		QVERIFY(!object->plan(Detail::CallSignatureFor<QPoint, int>::get())->valid);
+
+		object->destroyIfLastRef();
+		delete target;
+	}
 	void usingPointer()
 	{
 		Bindable *bindable = new Bindable;
@@ -174,6 +375,153 @@ private slots:
 		delete bindable1, bindable2, bindable3, bindable4, target;
 	}
 
+	void parentBindingsInvalidation()
+	{
+		Bindable *root = new Bindable;
+		Bindable *middle = new Bindable(root);
+		Bindable *leaf = new Bindable(middle);
+		Bindable *otherRoot = new Bindable;
+
+		TestTarget *target = new TestTarget;
+		root->bind("Hit", target, SLOT(hitMultipleAndReturn(int)));
+		QCOMPARE(leaf->wait<int>("Hit", 1), 1);
+		QCOMPARE(leaf->wait<int>("Hit", 1), 2);
+
+		// shadowing in an intermediate ancestor has to win over the cached root binding
+		middle->bind("Hit", target, SLOT(hitAndReturn()));
+		QCOMPARE(leaf->wait<int>("Hit"), 3);
+
+		middle->unbind("Hit");
+		QCOMPARE(leaf->wait<int>("Hit", 2), 5);
+
+		otherRoot->bind("Hit", target, SLOT(hitAndReturn()));
+		middle->setBindableParent(otherRoot);
+		QCOMPARE(leaf->wait<int>("Hit"), 6);
+		leaf->setBindableParent(root);
+		QCOMPARE(leaf->wait<int>("Hit", 4), 10);
+
+		delete leaf, middle, root, otherRoot, target;
+	}
+	void concurrentBindAndWait()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("Hit", target, &TestTarget::hit);
+
+		QThreadPool pool;
+		pool.setMaxThreadCount(4);
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(bindable, 200));
+		}
+		// rebinding while calls are in flight must neither lose nor duplicate any of them
+		for (int i = 0; i < 200; ++i)
+		{
+			if (i % 2)
+			{
+				bindable->bind("Hit", target, SLOT(hit()));
+			}
+			else
+			{
+				bindable->bind("Hit", target, &TestTarget::hit);
+			}
+			bindable->bind("Other", target, SLOT(hit()));
+			bindable->unbind("Other");
+		}
+		pool.waitForDone();
+		QCOMPARE(target->numHits, 800);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void concurrentReparentAndWait()
+	{
+		TestTarget *first = new TestTarget;
+		TestTarget *second = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		first->moveToThread(thread);
+		second->moveToThread(thread);
+		TestBindable *firstParent = new TestBindable;
+		TestBindable *secondParent = new TestBindable;
+		firstParent->bind("Hit", first, &TestTarget::hit);
+		secondParent->bind("Hit", second, &TestTarget::hit);
+		TestBindable *leaf = new TestBindable;
+		leaf->setBindableParent(firstParent);
+
+		QThreadPool pool;
+		pool.setMaxThreadCount(4);
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(leaf, 200));
+		}
+		for (int i = 0; i < 200; ++i)
+		{
+			leaf->setBindableParent(i % 2 ? firstParent : secondParent);
+		}
+		leaf->setBindableParent(secondParent);
+		pool.waitForDone();
+		QCOMPARE(first->numHits + second->numHits, 800);
+
+		// nothing looked up through the old parent is served from the cache anymore
+		const int hits = second->numHits;
+		for (int i = 0; i < 10; ++i)
+		{
+			leaf->wait<void>("Hit");
+		}
+		QCOMPARE(second->numHits, hits + 10);
+
+		thread->quit();
+		thread->wait();
+		delete leaf, firstParent, secondParent, thread, first, second;
+	}
+	void callbackIdKinds()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind(QString("HitMultipleAndReturn"), target, SLOT(hitMultipleAndReturn(int)));
+
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 1);
+		QCOMPARE(bindable->wait<int>(QLatin1String("HitMultipleAndReturn"), 1), 2);
+		QCOMPARE(bindable->wait<int>(QString("HitMultipleAndReturn"), 1), 3);
+		const QString longer = "xxHitMultipleAndReturnxx";
+		QCOMPARE(bindable->wait<int>(longer.midRef(2, longer.size() - 4), 1), 4);
+
+		bindable->bind(QString::fromUtf8("H\xc3\xa4mta"), target, SLOT(hitAndReturn()));
+		QCOMPARE(bindable->wait<int>("H\xc3\xa4mta"), 5);
+
+		delete bindable, target;
+	}
+	void bindingTable()
+	{
+		Detail::BindingTable table;
+		TestTarget *target = new TestTarget;
+		for (int i = 0; i < 100; ++i)
+		{
+			table.insert(QString::number(i), Detail::Binding(target, QMetaMethod()));
+		}
+		QCOMPARE(table.size(), 100);
+		for (int i = 0; i < 100; i += 2)
+		{
+			QVERIFY(table.remove(QString::number(i)));
+		}
+		QVERIFY(!table.remove("0"));
+		QCOMPARE(table.size(), 50);
+		for (int i = 0; i < 100; ++i)
+		{
+			QCOMPARE(table.find(QString::number(i)) != nullptr, i % 2 == 1);
+		}
+		table.insert("1", Detail::Binding(nullptr, QMetaMethod()));
+		QCOMPARE(table.size(), 50);
+		QCOMPARE(table.find("1")->m_receiver, static_cast<const QObject *>(nullptr));
+
+		delete target;
+	}
+
 	void asyncRequests()
 	{
 		Bindable *bindable = new Bindable;
@@ -235,6 +583,1130 @@ private slots:
 		QVERIFY(f1.isFinished());
 		QCOMPARE(f1.result(), 1);
 	}
+	void batchedDispatch()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		bindable->bind("Hit", target, SLOT(hit()));
+
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		Bindable::setBatchedDispatch(true);
+		Bindable::resetBatchStatistics();
+
+		// the first call blocks the receiver, so everything posted after it ends up in one batch
+		QList<QFuture<int>> futures;
+		target->mutex.lock();
+		for (int i = 0; i < 20; ++i)
+		{
+			futures.append(bindable->request<int>("HitAndReturn"));
+		}
+		target->mutex.unlock();
+		for (int i = 0; i < 20; ++i)
+		{
+			QCOMPARE(futures[i].result(), i + 1);
+		}
+		Detail::BatchStatistics statistics = Bindable::batchStatistics();
+		QCOMPARE(statistics.calls, quint64(20));
+		QVERIFY(statistics.largestBatch >= 10);
+
+		QThreadPool pool;
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(bindable, 25));
+		}
+		pool.waitForDone();
+		QCOMPARE(target->numHits, 120);
+		statistics = Bindable::batchStatistics();
+		QCOMPARE(statistics.calls, quint64(120));
+
+		Bindable::setBatchedDispatch(false);
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void waitSpinBudget()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn);
+
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		// both the parking and the spinning path have to hand over the result
+		for (const int budget : {0, 1000000, 4000})
+		{
+			Bindable::setWaitSpinBudget(budget);
+			for (int i = 0; i < 50; ++i)
+			{
+				bindable->wait<int>("HitMultipleAndReturn", 1);
+			}
+		}
+		QCOMPARE(target->numHits, 150);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void movedArguments()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("TakeOwnership", target, &TestTarget::takeOwnership);
+		bindable->bind("ByReference", target, &TestTarget::byReference);
+		bindable->bind("ByValue", target, &TestTarget::byValue);
+
+		QCOMPARE(bindable->wait<int>("TakeOwnership", std::unique_ptr<int>(new int(42))), 42);
+		CopyCounter::copies = 0;
+		bindable->wait<int>("ByReference", CopyCounter());
+		bindable->wait<int>("ByValue", CopyCounter());
+		bindable->request<int>("ByReference", CopyCounter()).waitForFinished();
+		QCOMPARE(CopyCounter::copies, 0);
+		CopyCounter lvalue;
+		bindable->wait<int>("ByValue", lvalue);
+		QCOMPARE(CopyCounter::copies, 1);
+
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		QCOMPARE(bindable->request<int>("TakeOwnership", std::unique_ptr<int>(new int(7))).result(),
+				 7);
+		CopyCounter::copies = 0;
+		bindable->wait<int>("ByReference", CopyCounter());
+		bindable->request<int>("ByValue", CopyCounter()).waitForFinished();
+		bindable->request<int>("ByReference", CopyCounter()).waitForFinished();
+		QCOMPARE(CopyCounter::copies, 0);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+#ifdef LOGICALGUI_METRICS
+	void callbackStatistics()
+	{
+		Bindable::resetCallbackStatistics();
+		Bindable *bindable = new Bindable;
+		TestTarget *local = new TestTarget;
+		TestTarget *remote = new TestTarget;
+		bindable->bind("Local", local, &TestTarget::hit);
+		bindable->bind("Remote", remote, &TestTarget::hitAndReturn);
+
+		QThread *thread = new QThread;
+		thread->start();
+		remote->moveToThread(thread);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			bindable->wait<void>("Local");
+		}
+		bindable->wait<int>("Remote");
+		bindable->wait<int>("Remote");
+		bindable->request<int>("Remote").waitForFinished();
+		bindable->waitFor<int>(-1, nullptr, "Remote");
+
+		auto sum = [](const QVector<quint64> &histogram)
+		{
+			quint64 total = 0;
+			for (const quint64 count : histogram)
+			{
+				total += count;
+			}
+			return total;
+		};
+		const QHash<QString, Detail::CallbackStatistics> statistics =
+			Bindable::callbackStatistics();
+		QCOMPARE(statistics["Local"].sameThreadCalls, quint64(3));
+		QCOMPARE(statistics["Local"].crossThreadCalls, quint64(0));
+		QCOMPARE(sum(statistics["Local"].latencyHistogram), quint64(3));
+		QCOMPARE(sum(statistics["Local"].queueingHistogram), quint64(0));
+		QCOMPARE(statistics["Remote"].crossThreadCalls, quint64(4));
+		QCOMPARE(sum(statistics["Remote"].latencyHistogram), quint64(4));
+		QCOMPARE(sum(statistics["Remote"].queueingHistogram), quint64(4));
+
+		Bindable::resetCallbackStatistics();
+		QVERIFY(Bindable::callbackStatistics().isEmpty());
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, local, remote;
+	}
+#endif
+	void traceExport()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("Remote", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		Bindable::startTracing(16);
+		bindable->wait<int>("Remote");
+		bindable->request<int>("Remote").waitForFinished();
+		Bindable::stopTracing();
+		bindable->wait<int>("Remote");
+
+		const QJsonDocument doc = QJsonDocument::fromJson(Bindable::traceJson());
+		QStringList events;
+		for (const QJsonValue &value : doc.object().value("traceEvents").toArray())
+		{
+			const QJsonObject event = value.toObject();
+			events.append(event.value("ph").toString() + " " + event.value("name").toString());
+		}
+		QCOMPARE(events, QStringList() << "B Remote"
+									   << "b queued Remote"
+									   << "s Remote"
+									   << "e queued Remote"
+									   << "f Remote"
+									   << "B run Remote"
+									   << "E run Remote"
+									   << "E Remote"
+									   << "b queued Remote"
+									   << "s Remote"
+									   << "e queued Remote"
+									   << "f Remote"
+									   << "B run Remote"
+									   << "E run Remote");
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void traceRestart()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("Hit", target, SLOT(hit()));
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		// resizing frees the old buffer while other threads are recording into it
+		QThreadPool pool;
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(bindable, 200));
+		}
+		for (int i = 0; i < 50; ++i)
+		{
+			Bindable::startTracing(16 << (i % 4));
+			QThread::yieldCurrentThread();
+		}
+		pool.waitForDone();
+		QCOMPARE(target->numHits, 800);
+
+		// nothing gets in after stopping
+		Bindable::stopTracing();
+		const QByteArray stopped = Bindable::traceJson();
+		QVERIFY(!QJsonDocument::fromJson(stopped).isNull());
+		bindable->wait<void>("Hit");
+		QCOMPARE(Bindable::traceJson(), stopped);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void waitForTimeout()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("Hit", target, SLOT(hit()));
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		bool ok = false;
+		QCOMPARE(bindable->waitFor<int>(5000, &ok, "HitAndReturn"), 1);
+		QVERIFY(ok);
+		bindable->waitFor<void>(-1, &ok, "Hit");
+		QVERIFY(ok);
+
+		// keep the receiver thread busy, so the next call stays queued
+		target->mutex.lock();
+		QFuture<int> blocker = bindable->request<int>("HitAndReturn");
+		QCOMPARE(bindable->waitFor<int>(50, &ok, "HitAndReturn"), 0);
+		QVERIFY(!ok);
+		target->mutex.unlock();
+		QCOMPARE(blocker.result(), 3);
+
+		// the timed out call was withdrawn
+		QCOMPARE(bindable->waitFor<int>(5000, &ok, "HitAndReturn"), 4);
+		QVERIFY(ok);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void cancelQueuedRequest()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		target->mutex.lock();
+		QFuture<int> blocker = bindable->request<int>("HitAndReturn");
+		QFuture<int> canceled = bindable->request<int>("HitAndReturn");
+		canceled.cancel();
+		target->mutex.unlock();
+		QCOMPARE(blocker.result(), 1);
+		canceled.waitForFinished();
+		QVERIFY(canceled.isCanceled());
+		QCOMPARE(bindable->wait<int>("HitAndReturn"), 2);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void continuations()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		QThread *contextThread = QThread::currentThread();
+		QList<int> seen;
+		bool onContextThread = true;
+		Detail::Request<QString> chain =
+			bindable->request<int>("HitMultipleAndReturn", 1)
+				.then(this, [&](int hits)
+				{
+					seen.append(hits);
+					onContextThread &= QThread::currentThread() == contextThread;
+					return bindable->request<int>("HitMultipleAndReturn", hits + 1);
+				})
+				.then(this, [&](int hits)
+				{
+					seen.append(hits);
+					onContextThread &= QThread::currentThread() == contextThread;
+					return QString::number(hits);
+				});
+		bool done = false;
+		Detail::Request<void> last = chain.then(this, [&done](const QString &)
+		{
+			done = true;
+		});
+		QTRY_VERIFY(last.isFinished());
+		QVERIFY(done);
+		QCOMPARE(chain.result(), QString("3"));
+		QCOMPARE(seen, QList<int>() << 1 << 3);
+		QVERIFY(onContextThread);
+
+		// canceling a request cancels what's chained to it
+		target->mutex.lock();
+		QFuture<int> blocker = bindable->request<int>("HitMultipleAndReturn", 1);
+		Detail::Request<int> canceled = bindable->request<int>("HitMultipleAndReturn", 1);
+		Detail::Request<int> next = canceled.then(this, [](int hits)
+		{
+			return hits;
+		});
+		canceled.cancel();
+		target->mutex.unlock();
+		QTRY_VERIFY(next.isFinished());
+		QVERIFY(next.isCanceled());
+		QCOMPARE(blocker.result(), 4);
+
+		// without a context, it runs on the thread that finished the request
+		QThread *ranOn = nullptr;
+		Detail::Request<int> anywhere =
+			bindable->request<int>("HitMultipleAndReturn", 1).then(nullptr, [&ranOn](int hits)
+			{
+				ranOn = QThread::currentThread();
+				return hits * 2;
+			});
+		QCOMPARE(anywhere.result(), 10);
+		QVERIFY(!anywhere.isCanceled());
+		QCOMPARE(ranOn, thread);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void fanOut()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *first = new TestTarget;
+		TestTarget *second = new TestTarget;
+		TestTarget *local = new TestTarget;
+		QThread *firstThread = new QThread;
+		QThread *secondThread = new QThread;
+		firstThread->start();
+		secondThread->start();
+		first->moveToThread(firstThread);
+		second->moveToThread(secondThread);
+		first->numHits = 10;
+		second->numHits = 20;
+
+		bindable->bind("HitMultipleAndReturn", first, &TestTarget::hitMultipleAndReturn);
+		bindable->addBinding("HitMultipleAndReturn", second, SLOT(hitMultipleAndReturn(int)));
+		bindable->addBinding("HitMultipleAndReturn", local, &TestTarget::hitMultipleAndReturn);
+
+		// results come back in the order the bindings were added
+		QCOMPARE(bindable->waitAll<int>("HitMultipleAndReturn", 1),
+				 QVector<int>() << 11 << 21 << 1);
+		const int sum = bindable->waitAllReduced<int>([](int &total, const int value)
+		{
+			total += value;
+		}, 0, "HitMultipleAndReturn", 1);
+		QCOMPARE(sum, 12 + 22 + 2);
+		// single calls only go to the newest binding
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 3);
+
+		bindable->addBinding("Hit", first, &TestTarget::hit);
+		bindable->addBinding("Hit", second, &TestTarget::hit);
+		QFuture<void> hits = bindable->requestAll<void>("Hit");
+		hits.waitForFinished();
+		QVERIFY(!hits.isCanceled());
+		QCOMPARE(first->numHits, 13);
+		QCOMPARE(second->numHits, 23);
+
+		// bind replaces all of them
+		bindable->bind("Hit", local, &TestTarget::hit);
+		bindable->waitAll<void>("Hit");
+		QCOMPARE(first->numHits, 13);
+		QCOMPARE(local->numHits, 4);
+
+		// one canceled call cancels them all
+		firstThread->quit();
+		firstThread->wait();
+		bindable->addBinding("Hit", first, &TestTarget::hit);
+		QFuture<void> canceled = bindable->requestAll<void>("Hit");
+		delete first;
+		firstThread->start();
+		canceled.waitForFinished();
+		QVERIFY(canceled.isCanceled());
+
+		firstThread->quit();
+		firstThread->wait();
+		secondThread->quit();
+		secondThread->wait();
+		delete bindable, second, local, firstThread, secondThread;
+	}
+	void requestMany()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		TestTarget *local = new TestTarget;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn);
+		bindable->bind("LocalHitMultipleAndReturn", local, &TestTarget::hitMultipleAndReturn);
+		QThread *thread = new QThread;
+		target->moveToThread(thread);
+
+		QVector<int> items;
+		QList<int> expected;
+		for (int i = 1; i <= 100; ++i)
+		{
+			items.append(i);
+			expected.append(i * (i + 1) / 2);
+		}
+		Detail::BulkOptions options;
+		options.maxInFlight = 3;
+		options.chunkSize = 7;
+		QFuture<int> queued =
+			bindable->requestMany<int>("HitMultipleAndReturn", items, options);
+		thread->start();
+		queued.waitForFinished();
+		QCOMPARE(queued.results(), expected);
+		QCOMPARE(queued.progressValue(), 100);
+
+		QCOMPARE(bindable->requestMany<int>("LocalHitMultipleAndReturn", items).results(),
+				 expected);
+
+		options.ordered = false;
+		target->reset();
+		QList<int> unordered =
+			bindable->requestMany<int>("HitMultipleAndReturn", items, options).results();
+		std::sort(unordered.begin(), unordered.end());
+		QCOMPARE(unordered, expected);
+
+		target->reset();
+		bindable->bind("HitMultiple", target, &TestTarget::hitMultiple);
+		QFuture<void> hits =
+			bindable->requestMany<void>("HitMultiple", QList<int>() << 1 << 2 << 3);
+		hits.waitForFinished();
+		QCOMPARE(target->numHits, 6);
+
+		// items that were never handled cancel the request
+		thread->quit();
+		thread->wait();
+		QFuture<int> canceled = bindable->requestMany<int>("HitMultipleAndReturn", items);
+		delete target;
+		thread->start();
+		canceled.waitForFinished();
+		QVERIFY(canceled.isCanceled());
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, local;
+	}
+	void cachedResults()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		Detail::BindingOptions options;
+		options.cacheSize = 2;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn,
+					   options);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 1);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 1);
+		QCOMPARE(target->numHits, 1);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 2), 3);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 1);
+		// evicts 2, which was used least recently
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 3), 6);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 1);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 2), 8);
+		QCOMPARE(target->numHits, 8);
+
+		bindable->invalidateCache("HitMultipleAndReturn");
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 9);
+
+		options.cacheTtl = 20;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn,
+					   options);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 10);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 10);
+		QThread::msleep(50);
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 1), 11);
+
+		// arguments that can't be hashed are passed through
+		bindable->bind("ByReference", target, &TestTarget::byReference, options);
+		QCOMPARE(bindable->wait<int>("ByReference", CopyCounter()), 12);
+		QCOMPARE(bindable->wait<int>("ByReference", CopyCounter()), 13);
+
+		// string literals are keyed on their contents, not on their type or address
+		bindable->bind("HitAndMeasure", target, &TestTarget::hitAndMeasure, options);
+		QCOMPARE(bindable->wait<int>("HitAndMeasure", "literal"), 7);
+		QCOMPARE(bindable->wait<int>("HitAndMeasure", "literal"), 7);
+		char copy[] = "literal";
+		QCOMPARE(bindable->wait<int>("HitAndMeasure", copy), 7);
+		QCOMPARE(target->numHits, 14);
+		QCOMPARE(bindable->wait<int>("HitAndMeasure", "other"), 5);
+		QCOMPARE(target->numHits, 15);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void singleFlight()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		Detail::BindingOptions options;
+		options.singleFlight = true;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn,
+					   options);
+		target->mutex.lock();
+		QList<QFuture<int>> shared;
+		for (int i = 0; i < 8; ++i)
+		{
+			shared.append(bindable->request<int>("HitMultipleAndReturn", 1));
+		}
+		QFuture<int> other = bindable->request<int>("HitMultipleAndReturn", 2);
+		target->mutex.unlock();
+		for (const QFuture<int> &future : shared)
+		{
+			QCOMPARE(future.result(), 1);
+		}
+		QCOMPARE(other.result(), 3);
+
+		// only calls that are still running are shared; this one might still be around for a
+		// moment after its result came in
+		int hits;
+		do
+		{
+			hits = bindable->wait<int>("HitMultipleAndReturn", 1);
+		} while (hits == 1);
+		QCOMPARE(hits, 4);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void singleFlightCancel()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		Detail::BindingOptions options;
+		options.singleFlight = true;
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn,
+					   options);
+		bindable->bind("Hit", target, &TestTarget::hold);
+
+		// one joiner canceling doesn't cancel the others
+		QFuture<void> held = bindable->request<void>("Hit");
+		target->entered.acquire();
+		QFuture<int> canceled = bindable->request<int>("HitMultipleAndReturn", 1);
+		QFuture<int> joined = bindable->request<int>("HitMultipleAndReturn", 1);
+		canceled.cancel();
+		target->proceed.release();
+		QCOMPARE(joined.result(), 2);
+		QVERIFY(canceled.isCanceled());
+		QVERIFY(!joined.isCanceled());
+		held.waitForFinished();
+
+		// but once all of them have, the call is skipped
+		held = bindable->request<void>("Hit");
+		target->entered.acquire();
+		QFuture<int> first = bindable->request<int>("HitMultipleAndReturn", 3);
+		QFuture<int> second = bindable->request<int>("HitMultipleAndReturn", 3);
+		first.cancel();
+		second.cancel();
+		target->proceed.release();
+		first.waitForFinished();
+		second.waitForFinished();
+		QVERIFY(first.isCanceled() && second.isCanceled());
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 5), 8);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void queueLimit()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		// keeps the receiver busy; a blocking call is never dropped
+		bindable->bind("Hit", target, &TestTarget::hold);
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		QThreadPool pool;
+		pool.setMaxThreadCount(3);
+
+		Bindable::setQueueLimit(thread, 1, Detail::BlockWhenFull);
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+		// calls only count until they're taken
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 0);
+		pool.start(new WaitRunner(bindable, 1));
+		QTRY_COMPARE(Bindable::queueStatistics(thread).pending, 1);
+		pool.start(new WaitRunner(bindable, 1));
+		QTRY_COMPARE(Bindable::queueStatistics(thread).blocked, quint64(1));
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 1);
+		// a waitFor only waits for room until its deadline, then it's rejected
+		bool ok = true;
+		QElapsedTimer timer;
+		timer.start();
+		QCOMPARE(bindable->waitFor<int>(50, &ok, "HitAndReturn"), 0);
+		QVERIFY(!ok);
+		QVERIFY(timer.elapsed() < 5000);
+		QCOMPARE(Bindable::queueStatistics(thread).rejected, quint64(1));
+		target->proceed.release(3);
+		pool.waitForDone();
+		target->entered.acquire(2);
+		QCOMPARE(target->numHits, 3);
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 0);
+
+		Bindable::setQueueLimit(thread, 1, Detail::FailWhenFull);
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+		QFuture<int> admitted = bindable->request<int>("HitAndReturn");
+		QFuture<int> rejected = bindable->request<int>("HitAndReturn");
+		QVERIFY(rejected.isCanceled());
+		// a wait() can't report it, so it's warned about
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: a blocking call was dropped, the "
+										   "receiver thread's queue is full");
+		QCOMPARE(bindable->wait<int>("HitAndReturn"), 0);
+		target->proceed.release();
+		QCOMPARE(admitted.result(), 5);
+		QCOMPARE(Bindable::queueStatistics(thread).rejected, quint64(3));
+		pool.waitForDone();
+		QTRY_COMPARE(Bindable::queueStatistics(thread).pending, 0);
+
+		Bindable::setQueueLimit(thread, 2, Detail::DropOldestWhenFull);
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+		QFuture<int> dropped = bindable->request<int>("HitAndReturn");
+		QFuture<int> second = bindable->request<int>("HitAndReturn");
+		QFuture<int> third = bindable->request<int>("HitAndReturn");
+		QCOMPARE(Bindable::queueStatistics(thread).highWater, 3);
+		// a blocking call couldn't be dropped later on, so it isn't queued at all
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: a blocking call was dropped, the "
+										   "receiver thread's queue is full");
+		QCOMPARE(bindable->wait<int>("HitAndReturn"), 0);
+		QCOMPARE(Bindable::queueStatistics(thread).rejected, quint64(4));
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 3);
+		target->proceed.release();
+		QCOMPARE(second.result(), 7);
+		QCOMPARE(third.result(), 8);
+		dropped.waitForFinished();
+		QVERIFY(dropped.isCanceled());
+		QCOMPARE(Bindable::queueStatistics(thread).dropped, quint64(1));
+		pool.waitForDone();
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void queueLimitExemptsContinuations()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		TestTarget *busy = new TestTarget;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		bindable->bind("Hold", busy, &TestTarget::hold);
+		bindable->bind("Fill", busy, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		QThread *contextThread = new QThread;
+		contextThread->start();
+		busy->moveToThread(contextThread);
+
+		// the context's thread is busy, and its queue is full
+		Bindable::setQueueLimit(contextThread, 1, Detail::FailWhenFull);
+		QFuture<void> held = bindable->request<void>("Hold");
+		busy->entered.acquire();
+		QFuture<int> filled = bindable->request<int>("Fill");
+		Detail::Request<int> next =
+			bindable->request<int>("HitAndReturn").then(busy, [](int hits)
+			{
+				return hits * 10;
+			});
+		// the continuation is queued behind the limit instead of being dropped
+		QTRY_COMPARE(Bindable::queueStatistics(contextThread).pending, 2);
+		QCOMPARE(Bindable::queueStatistics(contextThread).rejected, quint64(0));
+		busy->proceed.release();
+		QCOMPARE(next.result(), 10);
+		QCOMPARE(filled.result(), 2);
+		held.waitForFinished();
+
+		thread->quit();
+		thread->wait();
+		contextThread->quit();
+		contextThread->wait();
+		delete bindable, thread, contextThread, target, busy;
+	}
+	void priorityLanes()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		Detail::BindingOptions options;
+		options.priority = Detail::HighPriority;
+		bindable->bind("Hit", target, &TestTarget::hold, options);
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		QThreadPool pool;
+
+		// the blocking call keeps the receiver busy while the others are queued
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+		QList<QFuture<int>> low, high;
+		{
+			Detail::PriorityScope scope(Detail::LowPriority);
+			low << bindable->request<int>("HitAndReturn");
+			low << bindable->request<int>("HitAndReturn");
+		}
+		{
+			Detail::PriorityScope scope(Detail::HighPriority);
+			high << bindable->request<int>("HitAndReturn");
+			high << bindable->request<int>("HitAndReturn");
+		}
+		target->proceed.release();
+		QCOMPARE(high[0].result(), 2);
+		QCOMPARE(high[1].result(), 3);
+		QCOMPARE(low[0].result(), 4);
+		QCOMPARE(low[1].result(), 5);
+		pool.waitForDone();
+		QTRY_COMPARE(Bindable::queueStatistics(thread).pending, 0);
+
+		// a waiting low priority call gets its turn after at most 8 others
+		target->reset();
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+		QFuture<int> aged;
+		{
+			Detail::PriorityScope scope(Detail::LowPriority);
+			aged = bindable->request<int>("HitAndReturn");
+		}
+		high.clear();
+		{
+			Detail::PriorityScope scope(Detail::HighPriority);
+			for (int i = 0; i < 10; ++i)
+			{
+				high << bindable->request<int>("HitAndReturn");
+			}
+		}
+		target->proceed.release();
+		QCOMPARE(aged.result(), 10);
+		QCOMPARE(high.last().result(), 12);
+		pool.waitForDone();
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void executors()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		Detail::BindingOptions options;
+
+		// a receiver in another thread, called right here
+		Detail::InlineExecutor inlineExecutor;
+		options.executor = &inlineExecutor;
+		bindable->bind("Inline", target, &TestTarget::runningThread, options);
+		QCOMPARE(bindable->wait<QThread *>("Inline"), QThread::currentThread());
+
+		// a lambda, called in another thread
+		Detail::ThreadExecutor threadExecutor(thread);
+		options.executor = &threadExecutor;
+		bindable->bind("InThread", &callingThread, options);
+		QCOMPARE(bindable->wait<QThread *>("InThread"), thread);
+		QCOMPARE(bindable->request<QThread *>("InThread").result(), thread);
+
+		// both calls only return once the other one has started, too
+		Detail::PoolExecutor pool(2);
+		QCOMPARE(pool.threadCount(), 2);
+		options.executor = &pool;
+		bindable->bind("Parallel", &meetInParallel, options);
+		QFuture<bool> first = bindable->request<bool>("Parallel");
+		QFuture<bool> second = bindable->request<bool>("Parallel");
+		QVERIFY(s_started.tryAcquire(2, 5000));
+		s_proceed.release(2);
+		QVERIFY(first.result());
+		QVERIFY(second.result());
+
+		// one at a time and in order, although the pool has two threads
+		Detail::StrandExecutor strand(&pool);
+		options.executor = &strand;
+		bindable->bind("Serial", &runSerially, options);
+		QList<QFuture<void>> futures;
+		QVector<int> expected;
+		for (int i = 0; i < 50; ++i)
+		{
+			futures << bindable->request<void>("Serial", i);
+			expected << i;
+		}
+		for (QFuture<void> &future : futures)
+		{
+			future.waitForFinished();
+		}
+		QCOMPARE(s_overlaps.load(), 0);
+		QCOMPARE(s_order, expected);
+
+		// calls from outside the pool run oldest first, even when they pile up
+		Detail::PoolExecutor single(1);
+		options.executor = &single;
+		bindable->bind("Blocking", &meetInParallel, options);
+		bindable->bind("Ordered", &runSerially, options);
+		QFuture<bool> blocking = bindable->request<bool>("Blocking");
+		QVERIFY(s_started.tryAcquire(1, 5000));
+		s_order.clear();
+		futures.clear();
+		for (int i = 0; i < 50; ++i)
+		{
+			futures << bindable->request<void>("Ordered", i);
+		}
+		s_proceed.release();
+		QVERIFY(blocking.result());
+		for (QFuture<void> &future : futures)
+		{
+			future.waitForFinished();
+		}
+		QCOMPARE(s_order, expected);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void remoteBindings()
+	{
+		Bindable *served = new Bindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		served->bind("Hit", target, SLOT(hit()));
+		served->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn);
+		served->bind("Greet", &greet);
+		// the other end would normally be another process
+		Detail::RemoteHost host(served);
+		const QString name =
+			QString("tst_LogicalGui-%1").arg(QCoreApplication::applicationPid());
+		QVERIFY2(host.listen(name), qPrintable(host.errorString()));
+
+		Detail::RemoteOptions options;
+		options.sharedMemoryThreshold = 4096;
+		Detail::RemoteEndpoint endpoint(options);
+		QVERIFY(endpoint.connectToServer(name));
+		TestBindable *bindable = new TestBindable;
+		bindable->bindRemote("Hit", &endpoint);
+		bindable->bindRemote("AddHits", &endpoint, "HitMultipleAndReturn");
+		bindable->bindRemote("Greet", &endpoint);
+		bindable->bindRemote("Missing", &endpoint);
+
+		bindable->wait<void>("Hit");
+		QCOMPARE(bindable->wait<int>("AddHits", 2), 3);
+		QCOMPARE(bindable->wait<QString>("Greet", QString("you")), QString("Hello you"));
+		// goes through shared memory
+		const QString large(1 << 20, 'x');
+		QCOMPARE(bindable->wait<QString>("Greet", large), "Hello " + large);
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: remote call to Missing failed: "
+										   "no binding found for the given callback ID");
+		QCOMPARE(bindable->wait<int>("Missing"), 0);
+
+		// the callers share the connection
+		target->reset();
+		QThreadPool pool;
+		pool.setMaxThreadCount(4);
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(bindable, 25));
+		}
+		pool.waitForDone();
+		QCOMPARE(target->numHits, 100);
+
+		// a slow callback for one endpoint doesn't hold up the other ones
+		served->bind("Meet", &meetInParallel);
+		Detail::PoolExecutor caller(1);
+		Detail::BindingOptions callerOptions;
+		callerOptions.executor = &caller;
+		bindable->bindRemote("Meet", &endpoint, QString(), callerOptions);
+		QFuture<bool> met = bindable->request<bool>("Meet");
+		QVERIFY(s_started.tryAcquire(1, 5000));
+		Detail::RemoteEndpoint other;
+		QVERIFY(other.connectToServer(name));
+		TestBindable *otherBindable = new TestBindable;
+		otherBindable->bindRemote("Greet", &other);
+		QCOMPARE(otherBindable->wait<QString>("Greet", QString("me")), QString("Hello me"));
+		s_proceed.release();
+		QVERIFY(met.result());
+		delete otherBindable;
+
+		endpoint.disconnectFromServer();
+		QVERIFY(!endpoint.isConnected());
+		QTest::ignoreMessage(QtWarningMsg,
+							 "Bindable: remote call to Hit failed: not connected");
+		bindable->wait<void>("Hit");
+
+		thread->quit();
+		thread->wait();
+		delete bindable, served, thread, target;
+	}
+	void recordAndReplay()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("Hit", target, SLOT(hit()));
+		bindable->bind("HitMultipleAndReturn", target, &TestTarget::hitMultipleAndReturn);
+		bindable->bind("Greet", &greet);
+		bindable->bind("ByValue", target, &TestTarget::byValue);
+
+		QBuffer log;
+		log.open(QIODevice::ReadWrite);
+		QVERIFY(Bindable::startRecording(&log));
+		bindable->wait<void>("Hit");
+		QCOMPARE(bindable->wait<int>("HitMultipleAndReturn", 2), 3);
+		bindable->request<int>("HitMultipleAndReturn", 4).waitForFinished();
+		QCOMPARE(bindable->wait<QString>("Greet", QString("you")), QString("Hello you"));
+		// CopyCounter can't be serialized, so these are left out
+		QTest::ignoreMessage(QtWarningMsg, "Bindable: can't record calls to ByValue: not all "
+										   "of their argument types can be serialized");
+		bindable->wait<int>("ByValue", CopyCounter());
+		bindable->wait<int>("ByValue", CopyCounter());
+		QThreadPool pool;
+		pool.setMaxThreadCount(4);
+		for (int i = 0; i < 4; ++i)
+		{
+			pool.start(new WaitRunner(bindable, 25));
+		}
+		pool.waitForDone();
+		Bindable::stopRecording();
+		bindable->wait<void>("Hit");
+		QCOMPARE(target->numHits, 110);
+
+		target->reset();
+		log.seek(0);
+		Detail::Replay replay(bindable);
+		QVERIFY2(replay.load(&log), qPrintable(replay.errorString()));
+		QCOMPARE(replay.callCount(), 104);
+		// the pool's threads are told apart from the test's own
+		QVERIFY(replay.threadCount() >= 2);
+		Detail::ReplayStatistics statistics = replay.run(0);
+		QCOMPARE(statistics.calls, 104);
+		QCOMPARE(statistics.failed, 0);
+		QCOMPARE(target->numHits, 107);
+
+		// again, at a hundred times the recorded pace, without one of the bindings
+		bindable->unbind("Greet");
+		statistics = replay.run(100);
+		QCOMPARE(statistics.calls, 104);
+		QCOMPARE(statistics.failed, 1);
+		QCOMPARE(target->numHits, 214);
+
+		QBuffer garbage;
+		garbage.setData("not a recording");
+		garbage.open(QIODevice::ReadOnly);
+		QVERIFY(!replay.load(&garbage));
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void nestedEventLoop()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("SpinUntilHit", target, &TestTarget::spinUntilHit);
+		bindable->bind("Hit", target, SLOT(hit()));
+
+		QFuture<bool> spinning = bindable->request<bool>("SpinUntilHit");
+		// has to get through while the first call is still running
+		QThreadPool pool;
+		pool.start(new WaitRunner(bindable, 1));
+		pool.waitForDone();
+		QVERIFY(spinning.result());
+		QCOMPARE(target->numHits, 1);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void snapshotVersionsFreedDuringWait()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("Hit", target, &TestTarget::hold);
+		QThreadPool pool;
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+
+		// the blocked wait keeps its own version alive, but not the ones published after it
+		const int live = Detail::SnapshotVersion::liveCount();
+		for (int i = 0; i < 1000; ++i)
+		{
+			bindable->bind("Other", target, SLOT(hit()));
+			bindable->unbind("Other");
+		}
+		QVERIFY(Detail::SnapshotVersion::liveCount() <= live + 1);
+
+		target->proceed.release();
+		pool.waitForDone();
+		QCOMPARE(target->numHits, 1);
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void withdrawnCallsLeaveQueue()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("Hit", target, &TestTarget::hold);
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		QThreadPool pool;
+		Bindable::setQueueLimit(thread, 1, Detail::BlockWhenFull);
+		pool.start(new WaitRunner(bindable, 1));
+		target->entered.acquire();
+
+		// a waitFor that gives up frees its room, even though the call is still queued
+		bool ok = true;
+		QCOMPARE(bindable->waitFor<int>(50, &ok, "HitAndReturn"), 0);
+		QVERIFY(!ok);
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 0);
+		QFuture<int> admitted = bindable->request<int>("HitAndReturn");
+		QCOMPARE(Bindable::queueStatistics(thread).blocked, quint64(0));
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 1);
+		target->proceed.release();
+		// the withdrawn call is skipped
+		QCOMPARE(admitted.result(), 2);
+		pool.waitForDone();
+		QCOMPARE(Bindable::queueStatistics(thread).pending, 0);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void requestToDeletedReceiver()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+
+		QThread *thread = new QThread;
+		target->moveToThread(thread);
+
+		// queued while the receiver thread isn't running yet
+		QFuture<int> future = bindable->request<int>("HitAndReturn");
+		delete target;
+		thread->start();
+		future.waitForFinished();
+		QVERIFY(future.isCanceled());
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread;
+	}
+	void asyncRequestsDontBlockPool()
+	{
+		Bindable *bindable = new Bindable;
+		TestTarget *target = new TestTarget;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn);
+
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+
+		const int count = QThreadPool::globalInstance()->maxThreadCount() * 2;
+		QList<QFuture<int>> futures;
+		target->mutex.lock();
+		for (int i = 0; i < count; ++i)
+		{
+			futures.append(bindable->request<int>("HitAndReturn"));
+		}
+		QCOMPARE(QThreadPool::globalInstance()->activeThreadCount(), 0);
+		target->mutex.unlock();
+		for (int i = 0; i < count; ++i)
+		{
+			QCOMPARE(futures[i].result(), i + 1);
+		}
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
 };
 
 QTEST_GUILESS_MAIN(tst_LogicalGui)
@@ -0,0 +1,208 @@
+#include <QTest>
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <atomic>
+#include <exception>
+
+#include <LogicalGui.h>
+
+#ifndef __cpp_impl_coroutine
+#error "has to be compiled as C++20, see CMakeLists.txt"
+#endif
+
+class TestTarget : public QObject
+{
+	Q_OBJECT
+public:
+	explicit TestTarget(QObject *parent = nullptr) : QObject(parent)
+	{
+	}
+
+	/// Released by hold() once it's running, and acquired by it before it returns
+	QSemaphore entered, proceed;
+
+	int hold()
+	{
+		entered.release();
+		proceed.acquire();
+		return 7;
+	}
+
+public slots:
+	int hitAndReturn()
+	{
+		QMutexLocker locker(&mutex);
+		return ++numHits;
+	}
+	QThread *runningThread()
+	{
+		return QThread::currentThread();
+	}
+
+private:
+	QMutex mutex;
+	int numHits = 0;
+};
+
+class TestBindable : public Bindable
+{
+public:
+	using Bindable::askAsync;
+	using Bindable::askAsyncOn;
+	using Bindable::request;
+};
+
+/// The smallest coroutine type there is: starts right away, nobody waits for it
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object()
+		{
+			return Task();
+		}
+		std::suspend_never initial_suspend()
+		{
+			return std::suspend_never();
+		}
+		std::suspend_never final_suspend() noexcept
+		{
+			return std::suspend_never();
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+struct Outcome
+{
+	std::atomic<bool> resumed{false};
+	std::atomic<bool> destroyed{false};
+	int result = 0;
+	QThread *receiverThread = nullptr;
+	QThread *resumedOn = nullptr;
+};
+
+/// Sets Outcome::destroyed when the coroutine frame goes, whether it was resumed or not
+struct FrameGuard
+{
+	Outcome *outcome;
+	~FrameGuard()
+	{
+		outcome->destroyed = true;
+	}
+};
+
+static Task askTwice(TestBindable *bindable, Outcome *outcome)
+{
+	FrameGuard guard{outcome};
+	outcome->receiverThread = co_await bindable->askAsync<QThread *>("RunningThread");
+	outcome->result = co_await bindable->askAsync<int>("HitAndReturn");
+	outcome->result += co_await bindable->askAsync<int>("HitAndReturn");
+	outcome->resumedOn = QThread::currentThread();
+	outcome->resumed = true;
+}
+static Task askOnce(TestBindable *bindable, Outcome *outcome)
+{
+	FrameGuard guard{outcome};
+	outcome->result = co_await bindable->askAsync<int>("HitAndReturn");
+	outcome->resumed = true;
+}
+static Task askOn(TestBindable *bindable, const QObject *context, Outcome *outcome)
+{
+	FrameGuard guard{outcome};
+	outcome->result = co_await bindable->askAsyncOn<int>(context, "Hold");
+	outcome->resumed = true;
+}
+
+class tst_LogicalGui_coroutine : public QObject
+{
+	Q_OBJECT
+private slots:
+	void askAsyncAcrossThreads()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("RunningThread", target, SLOT(runningThread()));
+		bindable->bind("HitAndReturn", target, SLOT(hitAndReturn()));
+
+		Outcome outcome;
+		askTwice(bindable, &outcome);
+		// suspended until this thread's event loop runs the continuation
+		QVERIFY(!outcome.resumed);
+		QTRY_VERIFY(outcome.resumed);
+		QVERIFY(outcome.destroyed);
+		QCOMPARE(outcome.receiverThread, thread);
+		QCOMPARE(outcome.resumedOn, QThread::currentThread());
+		QCOMPARE(outcome.result, 3);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void askAsyncJoinsRequest()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		Detail::BindingOptions options;
+		options.singleFlight = true;
+		bindable->bind("HitAndReturn", target, &TestTarget::hitAndReturn, options);
+		bindable->bind("Hold", target, &TestTarget::hold);
+
+		// takes the same path as request(), so it shares the call that's still queued
+		QFuture<int> held = bindable->request<int>("Hold");
+		target->entered.acquire();
+		QFuture<int> requested = bindable->request<int>("HitAndReturn");
+		Outcome outcome;
+		askOnce(bindable, &outcome);
+		target->proceed.release();
+		QTRY_VERIFY(outcome.resumed);
+		QCOMPARE(outcome.result, 1);
+		QCOMPARE(requested.result(), 1);
+		QCOMPARE(held.result(), 7);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+	void askAsyncOnDeletedContext()
+	{
+		TestBindable *bindable = new TestBindable;
+		TestTarget *target = new TestTarget;
+		QThread *thread = new QThread;
+		thread->start();
+		target->moveToThread(thread);
+		bindable->bind("Hold", target, &TestTarget::hold);
+		QObject *context = new QObject;
+
+		Outcome outcome;
+		askOn(bindable, context, &outcome);
+		target->entered.acquire();
+		delete context;
+		target->proceed.release();
+		// destroyed instead of resumed, without ever running the rest of the coroutine
+		QTRY_VERIFY(outcome.destroyed);
+		QVERIFY(!outcome.resumed);
+		QCOMPARE(outcome.result, 0);
+
+		thread->quit();
+		thread->wait();
+		delete bindable, thread, target;
+	}
+};
+
+QTEST_GUILESS_MAIN(tst_LogicalGui_coroutine)
+
+#include "tst_LogicalGui_coroutine.moc"